@@ -8,6 +8,10 @@
 // -I/opt/homebrew/opt/curl/include -L/opt/homebrew/opt/curl/lib
 // -I/opt/homebrew/opt/nlohmann-json/include -lcurl -lfmt main.cpp && time
 // ./a.out
+//
+// The pool, year and phase of the tournament come from flags and/or a JSON
+// config file, e.g. "./a.out --config pool.json --when before-sweet16".  See
+// parse_args().
 
 // **********  TODO next year (2023)  **********
 //
@@ -126,17 +130,28 @@
 // On question to look at: in the next round, which outcome changes my chance of
 // winning the most?  Which pair or triple of outcomes?
 
+#include <arpa/inet.h>
 #include <curl/curl.h>
 #include <fcntl.h>
 #include <fmt/format.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <bit>
 #include <bitset>
 #include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory_resource>
 #include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
@@ -158,13 +173,17 @@
 
 #define COMMA ,
 
-// constexpr const char *WHEN_RUN = "before-final4";
-constexpr const char *WHEN_RUN = "before-roundof64";
-
-#define YEAR "2022"
+// Counters for where the time goes, see Profile.  Off unless built with
+// -DWITH_PROFILE=1, in which case --profile prints them at exit.
+#ifndef WITH_PROFILE
+#define WITH_PROFILE 0
+#endif
 
-constexpr const char *PROBS_FNAME =
-    YEAR "/{}-fivethirtyeight_ncaa_forecasts.csv";
+#if WITH_PROFILE
+#define PROFILE(expr) expr
+#else
+#define PROFILE(expr)
+#endif
 
 using game_t = int_fast8_t;
 using team_t = int_fast8_t;
@@ -173,50 +192,149 @@ constexpr team_t NUM_TEAMS = 64;
 constexpr game_t NUM_GAMES = NUM_TEAMS - 1;
 constexpr size_t NUM_ROUNDS = 6;
 
-// In 2022, before-roundof64 had ~ 16M in South-Midwest, which my Mackbook Air
-// could do in 1.6 seconds.  So we want the threshold higher than that.  Update:
-// No we don't, the extra precision doesn't make a difference, and it speeds up
-// a LOT by lowering it.
-constexpr size_t MONTE_CARLO_THRESHOLD = 1'000'000;
-// 100,000,000 iters runs out of RAM on Mac Airbook (8 GB).
-// 100,000 should be enough, even for all_optimzie().
-// Emperically, 1,000 makes a wrong choice.  So does 10,000, although (a) it's a
-// single wrong choice, so could be caught by looking at single flips, and (b)
-// it makes such a small difference, < 0.1%, that it's really in the noise.
-// Less than one extra win every 1,000 years. Game 50, UCLA vs Baylor in 2022.
-constexpr size_t MONTE_CARLO_ITERS = 100'000;
+// Scores are packed one byte per bracket into a scoretuple_t (see below), so
+// this is the biggest pool we can handle.
+constexpr size_t MAX_BRACKETS = 8;
 
 using namespace std;
 
 using namespace std::chrono;
 using json = nlohmann::json;
 
-constexpr size_t NUM_BRACKETS = 8;
-
-// Summary: lots of Villanova fans.  In 2022, optimizer chose Villanova to make
-// it to the championship.
-array<uint64_t, NUM_BRACKETS> entries{
-    60122219,  // me, Hoops, There It Is! (Martin, martinisquared)
-    62328104,  // Tara, TheGambler46.  Mostly 538 with a few tweaks.
-    58407997,  // Dan (Dan Murphy, dmurph888).  2MW Auburn to win, 3E Purdue
-               // over 2E Kentucky for Final 4.  2S Villanova over 1S Arizona.
-    58468455,  // Eileen-er-iffic (Eileen (Dan's Sister), The_MRF_NYC) 3E Purdue
-               // to win.  4MW Providence over 1 MW Kansas.
-    61439241,  // Vakidis (Billy (Maureen's Husband), wgarbarini) 3E Purdue over
-               // 2E Kentucky. 2S Villanova over 1S Arizona.  5MW Iowa over 1MW
-               // Kansas.  2S Villanova over 1MW Kansas to make it to
-               // championship.
-    62484411,  // Owe'n Charlie '22 (Uncle Dennis, tiger72pu).  2S Villanova
-               // over 1S Arizona.
-    65481077,  // Maureen's Annual Bonus (Joe (Eileen's Husband),
-               // gettinpiggywitit) 1S Arizona to win.  Sweet 16: 3S Tennessee
-               // over 2S Villanova.  3MW Wisconsin over 2MW Auburn.
-    69629125,  // RPcatsmounts! espn88461517 (Ryan Price, Dan's step brother).
-               // 1MW Kansas to win. 3E Purdue over 2E Kentucky. 3S Tennessee
-               // over 1S Arizona. 61783453,  # Villa-Mo-va 1 (Maureen (Dan's
-               // Sister), Villa-Mo-va)
+// Everything that changes from one pool, year or phase of the tournament to
+// the next.  The defaults are my 2022 pool.  Set from a JSON file with
+// --config and/or from individual flags, see parse_args().
+struct Config {
+    string year = "2022";
+
+    // Part of the name of every cached page, so each phase of the tournament
+    // gets its own snapshot.  E.g. "before-final4".
+    string when_run = "before-roundof64";
+
+    // Summary: lots of Villanova fans.  In 2022, optimizer chose Villanova to
+    // make it to the championship.
+    vector<uint64_t> entries{
+        60122219,  // me, Hoops, There It Is! (Martin, martinisquared)
+        62328104,  // Tara, TheGambler46.  Mostly 538 with a few tweaks.
+        58407997,  // Dan (Dan Murphy, dmurph888).  2MW Auburn to win, 3E
+                   // Purdue over 2E Kentucky for Final 4.  2S Villanova over
+                   // 1S Arizona.
+        58468455,  // Eileen-er-iffic (Eileen (Dan's Sister), The_MRF_NYC) 3E
+                   // Purdue to win.  4MW Providence over 1 MW Kansas.
+        61439241,  // Vakidis (Billy (Maureen's Husband), wgarbarini) 3E Purdue
+                   // over 2E Kentucky. 2S Villanova over 1S Arizona.  5MW Iowa
+                   // over 1MW Kansas.  2S Villanova over 1MW Kansas to make it
+                   // to championship.
+        62484411,  // Owe'n Charlie '22 (Uncle Dennis, tiger72pu).  2S
+                   // Villanova over 1S Arizona.
+        65481077,  // Maureen's Annual Bonus (Joe (Eileen's Husband),
+                   // gettinpiggywitit) 1S Arizona to win.  Sweet 16: 3S
+                   // Tennessee over 2S Villanova.  3MW Wisconsin over 2MW
+                   // Auburn.
+        69629125,  // RPcatsmounts! espn88461517 (Ryan Price, Dan's step
+                   // brother). 1MW Kansas to win. 3E Purdue over 2E Kentucky.
+                   // 3S Tennessee over 1S Arizona. 61783453,  # Villa-Mo-va 1
+                   // (Maureen (Dan's Sister), Villa-Mo-va)
+    };
+
+    // In 2022, before-roundof64 had ~ 16M in South-Midwest, which my Mackbook
+    // Air could do in 1.6 seconds.  So we want the threshold higher than that.
+    // Update: No we don't, the extra precision doesn't make a difference, and
+    // it speeds up a LOT by lowering it.
+    size_t monte_carlo_threshold = 1'000'000;
+    // 100,000,000 iters runs out of RAM on Mac Airbook (8 GB).
+    // 100,000 should be enough, even for all_optimzie().
+    // Emperically, 1,000 makes a wrong choice.  So does 10,000, although (a)
+    // it's a single wrong choice, so could be caught by looking at single
+    // flips, and (b) it makes such a small difference, < 0.1%, that it's
+    // really in the noise. Less than one extra win every 1,000 years. Game 50,
+    // UCLA vs Baylor in 2022.
+    size_t monte_carlo_iters = 100'000;
+
+    // Where head to head probabilities come from: "538", "bradley-terry" or
+    // "efficiency".  See ProbModel.
+    string prob_model = "538";
+
+    // When non-empty, replaces the scheme and host of every URL we fetch, e.g.
+    // "http://127.0.0.1:8538" to talk to the local stand-in started by
+    // serve().
+    string url_host_override;
+    // When negative, every file in the cache is valid forever, and pages are
+    // stored under names that include when_run, i.e. the snapshots we replay.
+    // Otherwise, pages are cached by URL in PageCache and revalidated with a
+    // conditional GET once they're older than this many seconds.
+    double cache_max_age = -1;
+    size_t max_in_flight = 8;
+
+    // Modes other than the usual "fetch, then optimize".
+    int serve_port = 0;
+    int fail_every = 0;
+    bool fetch_only = false;
+    double live_poll_interval = 0;
+    string batch_fpath;
+    // Where batch results go.  Empty means stdout.
+    string batch_output_fpath;
+    // When positive, evaluate the pool under ENSEMBLE_SIZE perturbed
+    // probability scenarios instead of optimizing.  In logit units, see
+    // make_ensemble().
+    double ensemble_sigma = 0;
+    uint64_t ensemble_seed = 1;
+    // Lump together teams that score the same from then on, e.g. because
+    // nobody picked them to win the next game, see buckets_for().  Exact, and
+    // fewer score tuples to keep track of in the later rounds.
+    bool collapse_unpicked = false;
+    // When positive, outcomes() throws away score tuples less likely than
+    // this as it goes.  Exact mode gets cheaper, and what we threw away is
+    // reported as an error bound when there's no Monte Carlo, see
+    // BasicWinProb::unaccounted.
+    double prune_epsilon = 0;
+    // Spread each game's Monte Carlo draws over team pairs by how unsettled
+    // their results are, instead of by probability alone, and stratify the
+    // draws within a pair.  See mc_draws().
+    bool adaptive_mc = false;
+    // When more than 1, runs outcomes() this many times with independent
+    // random numbers and reports a confidence interval, instead of
+    // optimizing.
+    int mc_replicates = 0;
+    // Where Monte Carlo draws come from: "random" for rng, "sobol" for
+    // scrambled Sobol points, see Sobol2.
+    string mc_sampling = "random";
+    // Instead of optimizing, compare Monte Carlo against the exact answer for
+    // a range of iters and sampling modes, see run_convergence().
+    bool mc_convergence = false;
+    // When non-empty, a directory of cached pages and forecasts laid out
+    // like the current directory, i.e. <year>/pages/...  Times the engine on
+    // each snapshot in it and prints JSON, see run_benchmark().
+    string bench_fixtures;
+    // Print the Profile counters at exit.  Needs WITH_PROFILE.
+    bool profile = false;
+    // Instead of optimizing, check every engine against the numbers we know
+    // for 2022, see run_accuracy().
+    bool accuracy = false;
+    // When non-empty, all_optimize() and double_optimize() save where they
+    // are here every checkpoint_interval seconds, and with resume, pick up
+    // from it.  See CheckpointFile.
+    string checkpoint_fpath;
+    double checkpoint_interval = 60;
+    bool resume = false;
+    // Distributed optimizing, see coordinate().  The coordinator listens on
+    // coordinate_port, and any number of processes started with worker_port
+    // set to the same port evaluate candidates for it.  distributed_search
+    // is which candidates: "all" for all_optimize()'s, "single" for
+    // single_optimize()'s.
+    int coordinate_port = 0;
+    int worker_port = 0;
+    string distributed_search = "all";
+    // When non-empty, progress and results also go here as JSON Lines, see
+    // EventLog, and the optimizers stop printing a line per candidate.
+    string events_fpath;
+    // When positive, load everything and then answer queries on this port
+    // instead of optimizing, see QueryService.
+    int query_port = 0;
 };
 
+Config config;
+
 /**********  Utilities: asserts and random number generator  **********/
 
 vector<string> split(string source, char delim) {
@@ -277,13 +395,228 @@ class Rand {
                uint64();
     }
 
+    // Box-Muller.  Throws away the second value, we don't need many.
+    double normal() {
+        double u1 = max(uniform(), numeric_limits<double>::min());
+        return sqrt(-2 * log(u1)) * cos(2 * M_PI * uniform());
+    }
+
    private:
     uint64_t state;
 };
 
-Rand rng;
+// One per thread, so Monte Carlo in worker threads doesn't race on the state.
+thread_local Rand rng;
+
+// Points in [0, 1)^2 from the first two dimensions of the Sobol sequence,
+// scrambled so each Sobol2 is an independent, unbiased sample: the first n
+// points fill the square much more evenly than n calls to rng.uniform().
+// Nested uniform scrambling, with the hash from Burley, "Practical
+// Hash-based Owen Scrambling", 2020.
+class Sobol2 {
+   public:
+    explicit Sobol2(uint64_t seed)
+        : index_seed_(seed), seed0_(seed >> 32), seed1_(seed * 0x9e3779b9) {}
+
+    pair<double, double> operator()(uint32_t i) const {
+        uint32_t index = scramble(i, index_seed_);
+        // First dimension: van der Corput, i.e. the bits of index reversed.
+        // Second: direction numbers from the polynomial x + 1.
+        uint32_t x0 = reverse(index);
+        uint32_t x1 = 0;
+        for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+            if (index & 1) {
+                x1 ^= v;
+            }
+        }
+        return {to_unit(scramble(x0, seed0_)), to_unit(scramble(x1, seed1_))};
+    }
+
+   private:
+    static uint32_t reverse(uint32_t x) {
+        x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+        x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+        x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+        x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Owen scrambling: each bit is flipped depending on the ones above it.
+    static uint32_t scramble(uint32_t x, uint32_t seed) {
+        x = reverse(x);
+        x += seed;
+        x ^= x * 0x6c50b47c;
+        x ^= x * 0xb82f1e52;
+        x ^= x * 0xc7afe638;
+        x ^= x * 0x8d22f6e6;
+        return reverse(x);
+    }
+
+    static double to_unit(uint32_t x) {
+        return x * (1.0 / 4294967296.0);
+    }
+
+    uint32_t index_seed_;
+    uint32_t seed0_;
+    uint32_t seed1_;
+};
+
+// Bump allocator for everything one evaluation of outcomes() builds.  Nothing
+// is freed on its own; reset() makes all of it available again in O(1) but
+// keeps the blocks, so once a thread has seen its biggest evaluation it stops
+// calling malloc altogether.
+class Arena : public pmr::memory_resource {
+   public:
+    void reset() {
+        block_ = 0;
+        used_ = 0;
+    }
+
+    size_t capacity() const {
+        size_t result = 0;
+        for (const auto &block : blocks_) {
+            result += block.size;
+        }
+        return result;
+    }
+
+   private:
+    struct Block {
+        unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        for (; block_ < blocks_.size(); ++block_, used_ = 0) {
+            Block &block = blocks_[block_];
+            uintptr_t start = reinterpret_cast<uintptr_t>(block.data.get());
+            uintptr_t result = (start + used_ + alignment - 1) & -alignment;
+            if (result + bytes <= start + block.size) {
+                used_ = result + bytes - start;
+                return reinterpret_cast<void *>(result);
+            }
+        }
+        // Double each time, so even a big evaluation only needs a few blocks.
+        size_t size = max({MIN_BLOCK_SIZE, capacity(), bytes + alignment});
+        blocks_.push_back({make_unique<char[]>(size), size});
+        return do_allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {}
+
+    bool do_is_equal(const memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    static constexpr size_t MIN_BLOCK_SIZE = 1 << 20;
+    vector<Block> blocks_;
+    size_t block_ = 0;
+    size_t used_ = 0;
+};
+
+// While one of these is alive, outcomes() on this thread allocates from arena,
+// and when it goes away the arena is reset.  So nothing outcomes() returns may
+// outlive it.
+class ArenaScope {
+   public:
+    explicit ArenaScope(Arena &arena) : previous_(current_) {
+        current_ = &arena;
+    }
+
+    ~ArenaScope() {
+        current_->reset();
+        current_ = previous_;
+    }
+
+    static pmr::memory_resource *resource() {
+        return current_ ? static_cast<pmr::memory_resource *>(current_)
+                        : pmr::new_delete_resource();
+    }
+
+   private:
+    static thread_local Arena *current_;
+    Arena *previous_;
+};
+
+thread_local Arena *ArenaScope::current_ = nullptr;
+
+/**********  Event log  **********/
+
+// Machine readable progress and results, one JSON object per line, for
+// dashboards and scripts that would otherwise have to scrape stdout.  Every
+// event gets "type" from its caller and "time" here.  emit() only queues the
+// event; a thread of its own turns them into text and writes them, so the
+// optimizers never wait on output.  Whatever's queued is written before the
+// EventLog goes away.
+class EventLog {
+   public:
+    explicit EventLog(const string &fpath) : out_(fpath, ios::app) {
+        if (!out_) {
+            throw runtime_error("Couldn't open event log " + fpath);
+        }
+        writer_ = thread(&EventLog::write_loop, this);
+    }
+
+    ~EventLog() {
+        {
+            scoped_lock lock(mutex_);
+            done_ = true;
+        }
+        queued_.notify_one();
+        writer_.join();
+    }
+
+    void emit(json event) {
+        event["time"] =
+            duration<double>(system_clock::now().time_since_epoch()).count();
+        {
+            scoped_lock lock(mutex_);
+            pending_.push_back(std::move(event));
+        }
+        queued_.notify_one();
+    }
+
+   private:
+    void write_loop() {
+        vector<json> batch;
+        for (;;) {
+            {
+                unique_lock lock(mutex_);
+                queued_.wait(lock, [&] { return done_ || !pending_.empty(); });
+                if (pending_.empty()) {
+                    return;
+                }
+                swap(batch, pending_);
+            }
+            for (const json &event : batch) {
+                out_ << event.dump() << '\n';
+            }
+            out_.flush();
+            batch.clear();
+        }
+    }
+
+    ofstream out_;
+    mutex mutex_;
+    condition_variable queued_;
+    vector<json> pending_;
+    bool done_ = false;
+    thread writer_;
+};
+
+// Null unless --events.
+unique_ptr<EventLog> event_log;
 
 /**********  Fetch a URL, with caching.  **********/
+
+string with_host_override(const string &url) {
+    if (config.url_host_override.empty()) {
+        return url;
+    }
+    size_t path = url.find('/', url.find("://") + 3);
+    return config.url_host_override + url.substr(path);
+}
+
 size_t write_callback(char *buffer, size_t size, size_t nmemb,
                       void *user_data) {
     stringstream &stream = *reinterpret_cast<stringstream *>(user_data);
@@ -293,59 +626,508 @@ size_t write_callback(char *buffer, size_t size, size_t nmemb,
     return size * nmemb;
 }
 
-std::string get_url(const string &url) {
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        throw runtime_error("curl_easy_init() failed.");
+size_t header_callback(char *buffer, size_t size, size_t nitems,
+                       void *user_data) {
+    auto &headers =
+        *reinterpret_cast<unordered_map<string, string> *>(user_data);
+
+    string line(buffer, size * nitems);
+    size_t colon = line.find(':');
+    if (colon != string::npos) {
+        string name = line.substr(0, colon);
+        for (auto &character : name) {
+            character = tolower(character);
+        }
+        size_t value_start = line.find_first_not_of(" \t", colon + 1);
+        size_t value_end = line.find_last_not_of(" \t\r\n");
+        headers[name] = value_start <= value_end
+                            ? line.substr(value_start, value_end - value_start + 1)
+                            : "";
     }
 
-    cout << "Fetching " << url << endl;
+    return size * nitems;
+}
 
-    stringstream stream;
+// Write to a temporary file in the same directory, then rename() it into
+// place, so a crash or a concurrent reader never sees a half written page.
+void write_cache_atomically(const string &fpath, const string &body) {
+    filesystem::path path(fpath);
+    if (path.has_parent_path()) {
+        filesystem::create_directories(path.parent_path());
+    }
 
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &stream);
+    string tmp_path = fpath + ".tmp" + to_string(getpid());
+    {
+        ofstream myoutfile(tmp_path, ios::binary);
+        if (!myoutfile) {
+            throw runtime_error("Error opening file to write " + tmp_path);
+        }
+        myoutfile << body;
+        myoutfile.close();
+        if (!myoutfile) {
+            throw runtime_error("Error writing " + tmp_path);
+        }
+    }
 
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        curl_easy_cleanup(curl);
-        throw runtime_error(curl_easy_strerror(res));
+    if (rename(tmp_path.c_str(), fpath.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        throw runtime_error("Error renaming " + tmp_path + " to " + fpath);
     }
+}
+
+optional<string> read_file(const string &fpath) {
+    ifstream myinfile(fpath, ios::binary);
+    if (!myinfile) {
+        return nullopt;
+    }
+    stringstream stream;
+    // TODO: How do I check for errors while reading?
+    stream << myinfile.rdbuf();
+    return stream.str();
+}
 
-    long http_code{0};
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-    if (http_code != 200) {
-        curl_easy_cleanup(curl);
-        throw runtime_error("Didn't get 200.");
+// 64 bit FNV-1a.  Not cryptographic, but we only use it to name cache files
+// and notice when a page changed.
+uint64_t fnv1a(const string &data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
     }
+    return hash;
+}
 
-    curl_easy_cleanup(curl);
+string content_hash(const string &data) {
+    return fmt::format("{:016x}-{}", fnv1a(data), data.size());
+}
 
-    return stream.str();
+int64_t unix_now() {
+    return duration_cast<seconds>(system_clock::now().time_since_epoch())
+        .count();
 }
 
-string get_with_caching(string url, string fpath) {
-    {
-        ifstream myinfile(fpath);
-        if (myinfile) {
-            stringstream stream;
-            // TODO: How do I check for errors while reading?
-            stream << myinfile.rdbuf();
-            return stream.str();
+string format_time(int64_t unix_time) {
+    time_t as_time_t = unix_time;
+    char buffer[64];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S",
+             localtime(&as_time_t));
+    return buffer;
+}
+
+// A cache keyed by URL, which remembers each page's ETag and Last-Modified so
+// it can be revalidated cheaply.  Bodies are stored by content hash, so pages
+// that are byte for byte identical (e.g. the same 538 CSV under two URLs, or a
+// page that changed and then changed back) are stored once.  Layout:
+//
+//   <year>/cache/meta/<hash of URL>.json  url, etag, last_modified, times, ...
+//   <year>/cache/objects/<content hash>   the body
+class PageCache {
+   public:
+    struct Meta {
+        string url;
+        string etag;
+        string last_modified;
+        string object;
+        // When the body last changed, i.e. the time of this snapshot.
+        int64_t fetched_at = 0;
+        // When the server last confirmed the body.
+        int64_t checked_at = 0;
+    };
+
+    optional<Meta> meta(const string &url) const {
+        auto raw = read_file(meta_fpath(url));
+        if (!raw) {
+            return nullopt;
+        }
+        json j = json::parse(*raw);
+        Meta result;
+        result.url = j["url"];
+        result.etag = j["etag"];
+        result.last_modified = j["last_modified"];
+        result.object = j["object"];
+        result.fetched_at = j["fetched_at"];
+        result.checked_at = j["checked_at"];
+        if (!filesystem::exists(object_fpath(result.object))) {
+            return nullopt;
+        }
+        return result;
+    }
+
+    bool is_fresh(const string &url) const {
+        if (checked_this_run_.contains(url)) {
+            return true;
+        }
+        auto existing = meta(url);
+        return existing &&
+               unix_now() - existing->checked_at < config.cache_max_age;
+    }
+
+    string body(const string &url) const {
+        auto existing = meta(url);
+        if (!existing) {
+            throw runtime_error("Not in cache: " + url);
+        }
+        auto result = read_file(object_fpath(existing->object));
+        if (!result) {
+            throw runtime_error("Missing cache object for " + url);
+        }
+        return *result;
+    }
+
+    // Record a 200 response.  Returns true if the body differs from what we
+    // had before.
+    bool store(const string &url, const string &body, const string &etag,
+               const string &last_modified) {
+        auto existing = meta(url);
+        Meta updated;
+        updated.url = url;
+        updated.etag = etag;
+        updated.last_modified = last_modified;
+        updated.object = content_hash(body);
+        updated.checked_at = unix_now();
+
+        bool changed = !existing || existing->object != updated.object;
+        updated.fetched_at = changed ? updated.checked_at : existing->fetched_at;
+
+        if (!filesystem::exists(object_fpath(updated.object))) {
+            write_cache_atomically(object_fpath(updated.object), body);
+        }
+        write_meta(updated);
+        return changed;
+    }
+
+    // Record a 304 Not Modified.
+    void touch(const string &url) {
+        auto existing = meta(url);
+        assert(existing);
+        existing->checked_at = unix_now();
+        write_meta(*existing);
+    }
+
+    // Identifies the combination of page contents behind a set of URLs, so
+    // callers can tell whether anything they depend on changed.
+    string snapshot_id(const vector<string> &urls) const {
+        string objects;
+        for (const auto &url : urls) {
+            auto existing = meta(url);
+            objects += (existing ? existing->object : "none") + "\n";
         }
+        return content_hash(objects);
     }
 
-    string body = get_url(url);
-    ofstream myoutfile(fpath);
-    if (!myoutfile) {
-        throw runtime_error("Error opening file to write " + fpath);
+    // Forget which pages we've confirmed, so the next Fetcher revalidates
+    // anything older than cache_max_age again.  For long running processes.
+    void expire_run_checks() {
+        checked_this_run_.clear();
     }
 
-    myoutfile << body;
+   private:
+    // Per year, like the rest of the cache.
+    string dir() const {
+        return config.year + "/cache";
+    }
+
+    string meta_fpath(const string &url) const {
+        return fmt::format("{}/meta/{:016x}.json", dir(), fnv1a(url));
+    }
+
+    string object_fpath(const string &object) const {
+        return dir() + "/objects/" + object;
+    }
+
+    void write_meta(const Meta &meta) {
+        json j;
+        j["url"] = meta.url;
+        j["etag"] = meta.etag;
+        j["last_modified"] = meta.last_modified;
+        j["object"] = meta.object;
+        j["fetched_at"] = meta.fetched_at;
+        j["checked_at"] = meta.checked_at;
+        write_cache_atomically(meta_fpath(meta.url), j.dump(4) + "\n");
+        checked_this_run_.insert(meta.url);
+    }
+
+    // Pages we've already confirmed in this process, so they're not
+    // revalidated again when cache_max_age is 0.
+    unordered_set<string> checked_this_run_;
+};
+
+PageCache page_cache;
+
+// Fetches many URLs at once using curl's multi interface.  All transfers share
+// the multi handle's connection cache, so we only pay for the TLS handshake
+// once per host.  At most max_in_flight transfers are active at a time.
+// Transient failures (connection problems, 429 and 5xx) are retried with
+// exponential backoff, up to max_attempts.
+//
+// Each body ends up either in its when_run snapshot file, or, when
+// cache_max_age >= 0, in page_cache.
+class Fetcher {
+   public:
+    Fetcher(size_t max_in_flight = 8, int max_attempts = 5)
+        : max_in_flight_(max_in_flight),
+          max_attempts_(max_attempts),
+          multi_(curl_multi_init()) {
+        if (!multi_) {
+            throw runtime_error("curl_multi_init() failed.");
+        }
+        curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                          (long)max_in_flight);
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    }
+
+    ~Fetcher() {
+        for (auto &[easy, transfer] : active_) {
+            curl_multi_remove_handle(multi_, easy);
+            curl_easy_cleanup(easy);
+            curl_slist_free_all(transfer->request_headers);
+        }
+        for (CURL *easy : idle_) {
+            curl_easy_cleanup(easy);
+        }
+        curl_multi_cleanup(multi_);
+    }
+
+    // Queue url, unless what we have cached is still good.
+    void add(const string &url, const string &fpath) {
+        auto transfer = make_unique<Transfer>();
+        transfer->url = url;
+        transfer->fpath = fpath;
+
+        if (config.cache_max_age < 0) {
+            if (filesystem::exists(fpath)) {
+                return;
+            }
+        } else {
+            if (page_cache.is_fresh(url)) {
+                return;
+            }
+            if (auto existing = page_cache.meta(url)) {
+                if (!existing->etag.empty()) {
+                    transfer->request_headers = curl_slist_append(
+                        transfer->request_headers,
+                        ("If-None-Match: " + existing->etag).c_str());
+                }
+                if (!existing->last_modified.empty()) {
+                    transfer->request_headers = curl_slist_append(
+                        transfer->request_headers,
+                        ("If-Modified-Since: " + existing->last_modified)
+                            .c_str());
+                }
+            }
+        }
+
+        pending_.push_back(std::move(transfer));
+    }
+
+    // Blocks until every transfer has either succeeded or given up.  Throws
+    // if any of them gave up, after the rest have finished.  Returns the
+    // number of pages whose contents changed.
+    size_t run() {
+        while (!pending_.empty() || !active_.empty()) {
+            start_ready();
+
+            int running;
+            curl_multi_perform(multi_, &running);
+            collect_finished();
+
+            if (!active_.empty()) {
+                curl_multi_poll(multi_, nullptr, 0, poll_timeout_ms(), nullptr);
+            } else if (!pending_.empty()) {
+                this_thread::sleep_for(milliseconds(poll_timeout_ms()));
+            }
+        }
+
+        if (!failures_.empty()) {
+            string message = "Failed to fetch:";
+            for (const auto &failure : failures_) {
+                message += "\n    " + failure;
+            }
+            failures_.clear();
+            throw runtime_error(message);
+        }
+
+        size_t num_changed = num_changed_;
+        num_changed_ = 0;
+        return num_changed;
+    }
+
+   private:
+    struct Transfer {
+        string url;
+        string fpath;
+        curl_slist *request_headers = nullptr;
+        stringstream body;
+        unordered_map<string, string> response_headers;
+        int attempts = 0;
+        time_point<steady_clock> not_before;
+    };
+
+    CURL *get_easy() {
+        if (!idle_.empty()) {
+            CURL *easy = idle_.back();
+            idle_.pop_back();
+            curl_easy_reset(easy);
+            return easy;
+        }
+        CURL *easy = curl_easy_init();
+        if (!easy) {
+            throw runtime_error("curl_easy_init() failed.");
+        }
+        return easy;
+    }
+
+    void start_ready() {
+        auto start_time = steady_clock::now();
+        auto iter = pending_.begin();
+        while (iter != pending_.end() && active_.size() < max_in_flight_) {
+            if ((*iter)->not_before > start_time) {
+                ++iter;
+                continue;
+            }
+
+            unique_ptr<Transfer> transfer = std::move(*iter);
+            iter = pending_.erase(iter);
+            ++transfer->attempts;
+            transfer->body.str("");
+            transfer->response_headers.clear();
+            cout << "Fetching " << transfer->url
+                 << (transfer->attempts > 1
+                         ? " (attempt " + to_string(transfer->attempts) + ")"
+                         : "")
+                 << endl;
+
+            CURL *easy = get_easy();
+            curl_easy_setopt(easy, CURLOPT_URL,
+                             with_host_override(transfer->url).c_str());
+            curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+            curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+            curl_easy_setopt(easy, CURLOPT_TIMEOUT, 60L);
+            curl_easy_setopt(easy, CURLOPT_HTTPHEADER,
+                             transfer->request_headers);
+            curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback);
+            curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer->body);
+            curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, header_callback);
+            curl_easy_setopt(easy, CURLOPT_HEADERDATA,
+                             &transfer->response_headers);
+            curl_multi_add_handle(multi_, easy);
+            active_.emplace(easy, std::move(transfer));
+        }
+    }
+
+    static bool is_transient(CURLcode res, long http_code) {
+        switch (res) {
+            case CURLE_OK:
+                return http_code == 429 || http_code >= 500;
+            case CURLE_COULDNT_CONNECT:
+            case CURLE_OPERATION_TIMEDOUT:
+            case CURLE_SEND_ERROR:
+            case CURLE_RECV_ERROR:
+            case CURLE_GOT_NOTHING:
+            case CURLE_PARTIAL_FILE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void finish(Transfer &transfer, long http_code) {
+        if (config.cache_max_age < 0) {
+            write_cache_atomically(transfer.fpath, transfer.body.str());
+            ++num_changed_;
+        } else if (http_code == 304) {
+            page_cache.touch(transfer.url);
+        } else if (page_cache.store(transfer.url, transfer.body.str(),
+                                    transfer.response_headers["etag"],
+                                    transfer.response_headers["last-modified"])) {
+            ++num_changed_;
+        }
+        curl_slist_free_all(transfer.request_headers);
+        transfer.request_headers = nullptr;
+    }
+
+    void collect_finished() {
+        int msgs_left;
+        while (CURLMsg *msg = curl_multi_info_read(multi_, &msgs_left)) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CURL *easy = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            long http_code{0};
+            curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_code);
+
+            curl_multi_remove_handle(multi_, easy);
+            auto node = active_.extract(easy);
+            idle_.push_back(easy);
+            unique_ptr<Transfer> transfer = std::move(node.mapped());
+
+            if (res == CURLE_OK &&
+                (http_code == 200 ||
+                 (http_code == 304 && transfer->request_headers))) {
+                finish(*transfer, http_code);
+                continue;
+            }
+
+            string error = res != CURLE_OK
+                               ? string(curl_easy_strerror(res))
+                               : "HTTP " + to_string(http_code);
+            if (is_transient(res, http_code) &&
+                transfer->attempts < max_attempts_) {
+                // 0.5s, 1s, 2s, ... with jitter, so a burst of failures
+                // doesn't retry in lock step.
+                double backoff = 0.5 * (1 << (transfer->attempts - 1)) *
+                                 (0.75 + 0.5 * rng.uniform());
+                cout << "Retrying " << transfer->url << " in " << backoff
+                     << " sec: " << error << endl;
+                transfer->not_before =
+                    steady_clock::now() +
+                    duration_cast<steady_clock::duration>(
+                        duration<double>(backoff));
+                pending_.push_back(std::move(transfer));
+            } else {
+                curl_slist_free_all(transfer->request_headers);
+                failures_.push_back(transfer->url + ": " + error);
+            }
+        }
+    }
+
+    int poll_timeout_ms() const {
+        int timeout = 100;
+        auto poll_time = steady_clock::now();
+        for (const auto &transfer : pending_) {
+            auto wait = duration_cast<milliseconds>(transfer->not_before -
+                                                    poll_time)
+                            .count();
+            timeout = min(timeout, (int)max(wait, (decltype(wait))1));
+        }
+        return timeout;
+    }
+
+    const size_t max_in_flight_;
+    const int max_attempts_;
+    CURLM *multi_;
+    vector<CURL *> idle_;
+    deque<unique_ptr<Transfer>> pending_;
+    unordered_map<CURL *, unique_ptr<Transfer>> active_;
+    vector<string> failures_;
+    size_t num_changed_ = 0;
+};
+
+string get_with_caching(string url, string fpath) {
+    Fetcher fetcher(1);
+    fetcher.add(url, fpath);
+    fetcher.run();
+
+    if (config.cache_max_age >= 0) {
+        return page_cache.body(url);
+    }
 
-    return body;
+    auto body = read_file(fpath);
+    if (!body) {
+        throw runtime_error("Error reading " + fpath);
+    }
+    return *body;
 }
 
 /**********  Read forecasts from CSV file  **********/
@@ -407,11 +1189,20 @@ struct CSVFile {
     }
 };
 
-string get_forecasts() {
-    return get_with_caching(
-        "https://projects.fivethirtyeight.com/march-madness-api/2022/"
+string forecasts_url() {
+    return fmt::format(
+        "https://projects.fivethirtyeight.com/march-madness-api/{}/"
         "fivethirtyeight_ncaa_forecasts.csv",
-        fmt::format(PROBS_FNAME, WHEN_RUN));
+        config.year);
+}
+
+string forecasts_fpath() {
+    return fmt::format("{}/{}-fivethirtyeight_ncaa_forecasts.csv",
+                       config.year, config.when_run);
+}
+
+string get_forecasts() {
+    return get_with_caching(forecasts_url(), forecasts_fpath());
 }
 
 CSVFile parse_csv() {
@@ -432,43 +1223,222 @@ CSVFile parse_csv() {
 
 vector<array<double, NUM_ROUNDS>> probs(NUM_TEAMS);
 
-void parse_probs() {
-    CSVFile csv = parse_csv();
+double get_prob(team_t team_index, int round) {
+    return probs[team_index][NUM_ROUNDS - 1 - round];
+}
 
-    int gender = csv.column("gender");
-    int name = csv.column("team_name");
-    int id = csv.column("team_id");
-    int playin = csv.column("playin_flag");
-    int rd2 = csv.column("rd2_win");
+// 538's power rating for each team, scaled like a point spread.  NaN if the
+// CSV doesn't have one.
+vector<double> ratings(NUM_TEAMS, NAN);
 
-    vector<bool> seen(NUM_TEAMS);
+// KenPom style adjusted efficiency margin (points per 100 possessions better
+// than an average team) and adjusted tempo (possessions per 40 minutes).  Only
+// filled in if <year>/efficiency.csv exists, see parse_efficiency().
+vector<double> efficiency_margins(NUM_TEAMS, NAN);
+vector<double> tempos(NUM_TEAMS, NAN);
 
-    for (auto &row : csv.rows) {
-        if (row[gender] != "mens") {
-            continue;
-        }
+// A way of estimating the chance that one team beats another in a given round.
+// Models are only consulted when building their GameProbTable, so which one we
+// use makes no difference to the speed of the hot loops.
+class ProbModel {
+   public:
+    virtual ~ProbModel() {}
+    virtual string name() const = 0;
+    // Whether we have the data this model needs.
+    virtual bool available() const = 0;
+    // The probability that first beats second in round.  May be NaN for
+    // teams that can't meet in that round.
+    virtual double prob(team_t first, team_t second, int round) const = 0;
+};
 
-        auto iter = eid_to_team.find(stoi(row[id]));
+// 538's rd*_win columns give each team's chance of winning each round, given
+// that it won the round before.  Assume the chance of first beating second is
+// proportional to those.  That's only exact when they took equally hard paths
+// to get there.
+class RatioModel : public ProbModel {
+   public:
+    string name() const override {
+        return "538";
+    }
 
-        if (iter == eid_to_team.end()) {
-            // Let's ignore unrecognized teams from the first four.
-            if (row[playin] == "0") {
-                cout << "Team " << row[name] << " eid " << row[id]
-                     << " from probability CSV not recognized.\n";
-                abort();
-            }
-            continue;
-        }
+    bool available() const override {
+        return true;
+    }
 
-        int team_id = iter->second;
+    double prob(team_t first, team_t second, int round) const override {
+        return get_prob(first, round) /
+               (get_prob(first, round) + get_prob(second, round));
+    }
+};
 
-        array<double, NUM_ROUNDS> &this_probs = probs[team_id];
-        if (!seen[team_id]) {
-            seen[team_id] = true;
-            double prev_prob;
-            for (size_t round = 0; round < NUM_ROUNDS; ++round) {
-                double this_prob = stod(row[rd2 + round]);
-                if (round == 0 || this_prob == 0.0) {
+// Bradley-Terry, i.e. log5, from 538's power ratings.  538 turns a rating
+// difference into a probability with a logistic curve, so each team's
+// strength is 10^(rating * 30.464 / 400).  Doesn't depend on the path.
+class RatingModel : public ProbModel {
+   public:
+    string name() const override {
+        return "bradley-terry";
+    }
+
+    bool available() const override {
+        return none_of(ratings.begin(), ratings.end(),
+                       [](double rating) { return isnan(rating); });
+    }
+
+    double prob(team_t first, team_t second, int /* round */) const override {
+        return 1.0 / (1.0 + pow(10.0, -(ratings[first] - ratings[second]) *
+                                          30.464 / 400));
+    }
+};
+
+// KenPom style: the difference in efficiency margins, scaled by the average
+// tempo, is the expected margin of victory.  The actual margin is roughly
+// normal around that, with a standard deviation of about 11 points.
+class EfficiencyModel : public ProbModel {
+   public:
+    string name() const override {
+        return "efficiency";
+    }
+
+    bool available() const override {
+        return none_of(efficiency_margins.begin(), efficiency_margins.end(),
+                       [](double margin) { return isnan(margin); });
+    }
+
+    double prob(team_t first, team_t second, int /* round */) const override {
+        double possessions = (tempos[first] + tempos[second]) / 2;
+        double margin = (efficiency_margins[first] -
+                         efficiency_margins[second]) *
+                        possessions / 100;
+        return 0.5 * erfc(-margin / (11.0 * sqrt(2.0)));
+    }
+};
+
+// The probability that first beats second in a given round, for every pair of
+// teams, so the hot loops in outcomes() and the optimizers do a lookup rather
+// than a division.  6 * 64 * 64 doubles is 192 KB, which stays in L2.
+struct alignas(64) GameProbTable {
+    array<array<array<double, NUM_TEAMS>, NUM_TEAMS>, NUM_ROUNDS> prob;
+};
+
+// One table per available model, rebuilt by parse_probs().  Switching models,
+// e.g. to run an ensemble, is just pointing game_probs at a different table.
+map<string, unique_ptr<GameProbTable>> game_prob_tables;
+const GameProbTable *game_probs = nullptr;
+
+void make_game_prob_tables() {
+    const RatioModel ratio;
+    const RatingModel rating;
+    const EfficiencyModel efficiency;
+    game_prob_tables.clear();
+    for (const ProbModel *model :
+         initializer_list<const ProbModel *>{&ratio, &rating, &efficiency}) {
+        if (!model->available()) {
+            continue;
+        }
+        auto table = make_unique<GameProbTable>();
+        for (size_t round = 0; round < NUM_ROUNDS; ++round) {
+            for (team_t first = 0; first < NUM_TEAMS; ++first) {
+                for (team_t second = 0; second < NUM_TEAMS; ++second) {
+                    table->prob[round][first][second] =
+                        model->prob(first, second, round);
+                }
+            }
+        }
+        game_prob_tables[model->name()] = std::move(table);
+    }
+}
+
+void use_prob_model(const string &name) {
+    auto iter = game_prob_tables.find(name);
+    if (iter == game_prob_tables.end()) {
+        throw runtime_error("Probability model " + name +
+                            " unknown, or missing its data.");
+    }
+    game_probs = iter->second.get();
+}
+
+vector<string> prob_model_names() {
+    vector<string> names;
+    for (const auto &[name, table] : game_prob_tables) {
+        names.push_back(name);
+    }
+    return names;
+}
+
+// Optional.  Columns: team_id (the same ids 538 uses), adj_em, adj_tempo.
+void parse_efficiency() {
+    auto raw = read_file(config.year + "/efficiency.csv");
+    if (!raw) {
+        return;
+    }
+    stringstream mystream(*raw);
+    string line;
+    if (!getline(mystream, line)) {
+        throw runtime_error("Failed to read header from efficiency CSV file.");
+    }
+    auto headers = split(line, ',');
+    auto column = [&](const string &name) {
+        auto iter = find(headers.begin(), headers.end(), name);
+        if (iter == headers.end()) {
+            throw runtime_error("Efficiency CSV file has no " + name);
+        }
+        return iter - headers.begin();
+    };
+    auto id = column("team_id");
+    auto adj_em = column("adj_em");
+    auto adj_tempo = column("adj_tempo");
+    while (getline(mystream, line)) {
+        auto row = split(line, ',');
+        auto iter = eid_to_team.find(stoi(row[id]));
+        if (iter != eid_to_team.end()) {
+            efficiency_margins[iter->second] = stod(row[adj_em]);
+            tempos[iter->second] = stod(row[adj_tempo]);
+        }
+    }
+}
+
+void parse_probs() {
+    CSVFile csv = parse_csv();
+
+    int gender = csv.column("gender");
+    int name = csv.column("team_name");
+    int id = csv.column("team_id");
+    int playin = csv.column("playin_flag");
+    int rd2 = csv.column("rd2_win");
+    int rating = csv.column("team_rating");
+
+    vector<bool> seen(NUM_TEAMS);
+
+    for (auto &row : csv.rows) {
+        if (row[gender] != "mens") {
+            continue;
+        }
+
+        auto iter = eid_to_team.find(stoi(row[id]));
+
+        if (iter == eid_to_team.end()) {
+            // Let's ignore unrecognized teams from the first four.
+            if (row[playin] == "0") {
+                cout << "Team " << row[name] << " eid " << row[id]
+                     << " from probability CSV not recognized.\n";
+                abort();
+            }
+            continue;
+        }
+
+        int team_id = iter->second;
+
+        array<double, NUM_ROUNDS> &this_probs = probs[team_id];
+        if (!seen[team_id]) {
+            seen[team_id] = true;
+            if (rating < (int)csv.headers.size()) {
+                ratings[team_id] = stod(row[rating]);
+            }
+            double prev_prob;
+            for (size_t round = 0; round < NUM_ROUNDS; ++round) {
+                double this_prob = stod(row[rd2 + round]);
+                if (round == 0 || this_prob == 0.0) {
                     this_probs[round] = this_prob;
                 } else {
                     this_probs[round] = this_prob / prev_prob;
@@ -478,10 +1448,10 @@ void parse_probs() {
             }
         }
     }
-}
 
-double get_prob(team_t team_index, int round) {
-    return probs[team_index][NUM_ROUNDS - 1 - round];
+    parse_efficiency();
+    make_game_prob_tables();
+    use_prob_model(config.prob_model);
 }
 
 double game_prob(team_t first, team_t second, team_t winner, int round) {
@@ -490,8 +1460,8 @@ double game_prob(team_t first, team_t second, team_t winner, int round) {
     assert(second >= 0);
     assert(winner == first || winner == second);
 
-    double result = get_prob(winner, round) /
-                    (get_prob(first, round) + get_prob(second, round));
+    double result =
+        game_probs->prob[round][winner][winner == first ? second : first];
     if (isnan(result)) {
         cout << "first: " << (int)first << " " << teams[first].name
              << ", second: " << (int)second << " " << teams[second].name
@@ -504,16 +1474,194 @@ double game_prob(team_t first, team_t second, team_t winner, int round) {
     return result;
 }
 
+// Number of probability scenarios in an ensemble.  8 doubles is one AVX-512
+// register, or two AVX2 ones.
+constexpr size_t ENSEMBLE_SIZE = 8;
+
+// A probability under each of ENSEMBLE_SIZE scenarios.  Arithmetic is
+// lane-wise and gcc turns it into SIMD, so outcomes() can walk the score
+// tuples once for the whole ensemble rather than once per scenario.
+struct ProbVec {
+    // aligned(8) rather than the natural 64, so ResultSets in the
+    // unordered_map nodes aren't padded out to a cache line.
+    typedef double Lanes
+        __attribute__((vector_size(ENSEMBLE_SIZE * sizeof(double)), aligned(8)));
+    Lanes lanes;
+
+    ProbVec(double x = 0) : lanes(Lanes{} + x) {}
+
+    double operator[](size_t i) const {
+        return lanes[i];
+    }
+    void set(size_t i, double x) {
+        lanes[i] = x;
+    }
+
+    ProbVec &operator+=(const ProbVec &other) {
+        lanes += other.lanes;
+        return *this;
+    }
+    friend ProbVec operator+(ProbVec a, const ProbVec &b) {
+        a.lanes += b.lanes;
+        return a;
+    }
+    friend ProbVec operator-(ProbVec a, const ProbVec &b) {
+        a.lanes -= b.lanes;
+        return a;
+    }
+    friend ProbVec operator*(ProbVec a, const ProbVec &b) {
+        a.lanes *= b.lanes;
+        return a;
+    }
+    friend ProbVec operator/(ProbVec a, const ProbVec &b) {
+        a.lanes /= b.lanes;
+        return a;
+    }
+};
+
+ostream &operator<<(ostream &out, const ProbVec &p) {
+    for (size_t i = 0; i < ENSEMBLE_SIZE; ++i) {
+        out << (i ? " " : "") << p[i];
+    }
+    return out;
+}
+
+// The few places outcomes() needs a single number, e.g. to size Monte Carlo,
+// use the mean over scenarios.
+double mean(double p) {
+    return p;
+}
+
+double mean(const ProbVec &p) {
+    double sum = 0;
+    for (size_t i = 0; i < ENSEMBLE_SIZE; ++i) {
+        sum += p[i];
+    }
+    return sum / ENSEMBLE_SIZE;
+}
+
+// a / b, but 0 where b is.
+double fraction(double a, double b) {
+    return b > 0 ? a / b : 0;
+}
+
+ProbVec fraction(const ProbVec &a, const ProbVec &b) {
+    ProbVec result;
+    for (size_t i = 0; i < ENSEMBLE_SIZE; ++i) {
+        result.set(i, fraction(a[i], b[i]));
+    }
+    return result;
+}
+
+double max_lane(double p) {
+    return p;
+}
+
+double max_lane(const ProbVec &p) {
+    double result = p[0];
+    for (size_t i = 1; i < ENSEMBLE_SIZE; ++i) {
+        result = max(result, p[i]);
+    }
+    return result;
+}
+
+struct EnsembleProbTable {
+    array<array<array<ProbVec, NUM_TEAMS>, NUM_TEAMS>, NUM_ROUNDS> prob;
+};
+
+unique_ptr<EnsembleProbTable> ensemble_probs;
+
+// Scenario 0 is game_probs as is.  In each of the others, every team's
+// strength moves by its own draw from N(0, sigma), in logit space.  Moving
+// teams rather than games keeps P(a beats b) + P(b beats a) == 1, and a team
+// that's better than 538 thinks is better in every round.
+void make_ensemble(double sigma, uint64_t seed) {
+    Rand scenario_rng(seed);
+    array<ProbVec, NUM_TEAMS> shifts;
+    for (team_t team = 0; team < NUM_TEAMS; ++team) {
+        for (size_t i = 1; i < ENSEMBLE_SIZE; ++i) {
+            shifts[team].set(i, sigma * scenario_rng.normal());
+        }
+    }
+
+    ensemble_probs = make_unique<EnsembleProbTable>();
+    for (size_t round = 0; round < NUM_ROUNDS; ++round) {
+        for (team_t winner = 0; winner < NUM_TEAMS; ++winner) {
+            for (team_t loser = 0; loser < NUM_TEAMS; ++loser) {
+                double prob = game_probs->prob[round][winner][loser];
+                ProbVec &dest = ensemble_probs->prob[round][winner][loser];
+                for (size_t i = 0; i < ENSEMBLE_SIZE; ++i) {
+                    // NaN, 0 and 1 stay as they are.
+                    if (!(prob > 0 && prob < 1)) {
+                        dest.set(i, prob);
+                        continue;
+                    }
+                    double logit = log(prob / (1 - prob)) + shifts[winner][i] -
+                                   shifts[loser][i];
+                    dest.set(i, 1 / (1 + exp(-logit)));
+                }
+            }
+        }
+    }
+}
+
+ProbVec ensemble_game_prob(team_t first, team_t second, team_t winner,
+                           int round) {
+    assert(winner == first || winner == second);
+    const ProbVec &result = ensemble_probs->prob[round][winner]
+                                                [winner == first ? second
+                                                                 : first];
+    assert(!isnan(result[0]));
+    return result;
+}
+
+template <typename Prob>
+Prob game_prob_for(team_t first, team_t second, team_t winner, int round) {
+    if constexpr (is_same_v<Prob, ProbVec>) {
+        return ensemble_game_prob(first, second, winner, round);
+    } else {
+        return game_prob(first, second, winner, round);
+    }
+}
+
 /**********  Fetch a bracket, extract & parse JSON  **********/
 
-string URL_FORMAT =
-    "https://fantasy.espn.com/tournament-challenge-bracket/" YEAR
-    "/en/entry?entryID={}";
+constexpr const char *URL_FORMAT =
+    "https://fantasy.espn.com/tournament-challenge-bracket/{}/en/"
+    "entry?entryID={}";
+
+string entry_url(uint64_t entry) {
+    return fmt::format(URL_FORMAT, config.year, entry);
+}
+
+string entry_fpath(uint64_t entry) {
+    return fmt::format("{}/pages/{}-{}.html", config.year, entry,
+                       config.when_run);
+}
 
 string get_entry(uint64_t entry) {
-    return get_with_caching(
-        fmt::format(URL_FORMAT, entry),
-        fmt::format(YEAR "/pages/{}-{}.html", entry, WHEN_RUN));
+    return get_with_caching(entry_url(entry), entry_fpath(entry));
+}
+
+vector<string> input_urls() {
+    vector<string> urls;
+    for (auto entry : config.entries) {
+        urls.push_back(entry_url(entry));
+    }
+    urls.push_back(forecasts_url());
+    return urls;
+}
+
+// Fetch everything we're going to need that isn't already cached (or needs
+// revalidating), several pages at a time, so refreshing a big pool doesn't
+// take one round trip per entry.  Returns the number of pages that changed.
+size_t prefetch(const vector<uint64_t> &entries, size_t max_in_flight) {
+    Fetcher fetcher(max_in_flight);
+    for (auto entry : entries) {
+        fetcher.add(entry_url(entry), entry_fpath(entry));
+    }
+    fetcher.add(forecasts_url(), forecasts_fpath());
+    return fetcher.run();
 }
 
 json get_json(const string &var, const string &source) {
@@ -530,6 +1678,193 @@ json get_json(const string &var, const string &source) {
     return json::parse(raw);
 }
 
+/**********  Local stand-in for ESPN and 538, for testing offline  **********/
+
+// Serves the pages in our cache directory over HTTP, the way ESPN and 538
+// would, so the fetching code can be exercised without the network.  E.g.:
+//
+//   (cd fixtures && ../a.out --serve 8538 --fail-every 3) &
+//   ./a.out --url-base http://127.0.0.1:8538 --fetch-only
+//
+// With fail_every > 0, every fail_every'th request gets a 503, to exercise
+// retries.  Pages get an ETag from their content hash, and If-None-Match gets
+// a 304, to exercise revalidation.
+
+string cache_fpath_for(const string &target) {
+    size_t entry_pos = target.find("entryID=");
+    if (target.starts_with("/tournament-challenge-bracket/") &&
+        entry_pos != string::npos) {
+        // A bad ID is just a page we don't have.
+        try {
+            return entry_fpath(stoull(target.substr(entry_pos + 8)));
+        } catch (const invalid_argument &) {
+            return "";
+        } catch (const out_of_range &) {
+            return "";
+        }
+    }
+    if (target.ends_with("/fivethirtyeight_ncaa_forecasts.csv")) {
+        return forecasts_fpath();
+    }
+    return "";
+}
+
+bool send_all(int fd, const string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent,
+                         MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+struct HttpResponse {
+    int status = 200;
+    string body;
+    string etag;
+    string content_type;
+};
+
+// Answers HTTP/1.1 requests on fd with handle(request_line, request), until
+// the other end closes or asks to.  request is everything up to the blank
+// line, i.e. the request line and the headers.
+void serve_http(
+    int fd,
+    const function<HttpResponse(const vector<string> &, const string &)>
+        &handle) {
+    string buffer;
+    char chunk[4096];
+    for (;;) {
+        size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == string::npos) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            buffer.append(chunk, n);
+        }
+        string request = buffer.substr(0, header_end);
+        buffer.erase(0, header_end + 4);
+
+        auto request_line = split(request.substr(0, request.find('\r')), ' ');
+        bool keep_alive = request.find("Connection: close") == string::npos;
+
+        HttpResponse reply = handle(request_line, request);
+
+        string response = fmt::format(
+            "HTTP/1.1 {} {}\r\nContent-Length: {}\r\nConnection: {}\r\n",
+            reply.status, reply.status == 200 ? "OK" : "Error",
+            reply.body.size(), keep_alive ? "keep-alive" : "close");
+        if (!reply.etag.empty()) {
+            response += "ETag: " + reply.etag + "\r\n";
+        }
+        if (!reply.content_type.empty()) {
+            response += "Content-Type: " + reply.content_type + "\r\n";
+        }
+        response += "\r\n";
+        if (!send_all(fd, response + reply.body) || !keep_alive) {
+            close(fd);
+            return;
+        }
+    }
+}
+
+void serve_connection(int fd, int fail_every, atomic<int> &num_requests) {
+    serve_http(fd, [&](const vector<string> &request_line,
+                       const string &request) {
+        HttpResponse reply;
+        int request_num = ++num_requests;
+        if (request_line.size() != 3 || request_line[0] != "GET") {
+            reply.status = 400;
+        } else if (fail_every > 0 && request_num % fail_every == 0) {
+            reply.status = 503;
+        } else {
+            string fpath = cache_fpath_for(request_line[1]);
+            auto contents = fpath.empty() ? nullopt : read_file(fpath);
+            if (!contents) {
+                reply.status = 404;
+            } else {
+                reply.etag = "\"" + content_hash(*contents) + "\"";
+                if (request.find("If-None-Match: " + reply.etag) !=
+                    string::npos) {
+                    reply.status = 304;
+                } else {
+                    reply.body = std::move(*contents);
+                }
+            }
+        }
+
+        cout << "Serving " << reply.status << " "
+             << (request_line.size() > 1 ? request_line[1] : "?") << endl;
+        return reply;
+    });
+}
+
+// Only on 127.0.0.1, nothing here is meant to be reachable from elsewhere.
+sockaddr_in loopback_addr(int port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    return addr;
+}
+
+int listen_on_loopback(int port) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw runtime_error("socket() failed.");
+    }
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = loopback_addr(port);
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) <
+            0 ||
+        listen(listen_fd, 64) < 0) {
+        close(listen_fd);
+        throw runtime_error("Couldn't listen on port " + to_string(port));
+    }
+    return listen_fd;
+}
+
+// The next '\n' terminated line from fd, without the '\n'.  buffer holds
+// whatever came in after it, for next time.  nullopt once the other end is
+// gone.
+optional<string> recv_line(int fd, string &buffer) {
+    char chunk[4096];
+    size_t end;
+    while ((end = buffer.find('\n')) == string::npos) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return nullopt;
+        }
+        buffer.append(chunk, n);
+    }
+    string line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    return line;
+}
+
+void serve(int port, int fail_every) {
+    int listen_fd = listen_on_loopback(port);
+    cout << "Serving " << config.year << " " << config.when_run
+         << " pages on http://127.0.0.1:" << port << endl;
+
+    atomic<int> num_requests{0};
+    for (;;) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        thread(serve_connection, fd, fail_every, ref(num_requests)).detach();
+    }
+}
+
 /**********  Manipulate indexes of matches  **********/
 
 struct Round {
@@ -539,42 +1874,107 @@ struct Round {
     int index;
 };
 
-inline Round round_index(int match) {
+// The shape of a single elimination tournament of NumTeams teams, worked out
+// at compile time so the lookups in outcomes() and friends are just array
+// reads.  Matches are numbered round by round, from the first round up to
+// the championship, and the winners of matches 2i and 2i + 1 of one round
+// play match i of the next.  Rounds count down from the championship, which
+// is round 0.
+template <int NumTeams>
+struct Topology {
+    // A power of two, and few enough games for a bit each in downstream.
+    static_assert(has_single_bit(unsigned(NumTeams)) && NumTeams <= 64);
+    static constexpr int num_games = NumTeams - 1;
+    static constexpr int num_rounds = bit_width(unsigned(NumTeams)) - 1;
+
+    // Everything is indexed by match.  index in round is one based, i.e.
+    // goes from 1 .. 32 for the Round of 64.
+    array<Round, num_games> round{};
+    // The match whose winner is the first team in this one; the second
+    // team comes from first_input + 1.  -1 in the first round.
+    array<int, num_games> first_input{};
+    // The match the winner of this one goes on to, -1 for the championship.
+    array<int, num_games> output{};
+    // 10 for the first round, doubling every round after.
+    array<int, num_games> points{};
+    // Bit m set for this match and every match its winner goes on to, i.e.
+    // everything whose outcomes depend on it.
+    array<uint64_t, num_games> downstream{};
+    // See slack_after().
+    array<int, num_games> slack{};
+    // The first round matches that feed into this one are first_leaf ..
+    // first_leaf + num_leaves - 1, so its possible winners are the teams in
+    // those.
+    array<int, num_games> first_leaf{};
+    array<int, num_games> num_leaves{};
+
+    constexpr Topology() {
+        int previous_first = 0;
+        int first = 0;
+        for (int r = num_rounds - 1; r >= 0; --r) {
+            int num_matches = 1 << r;
+            for (int i = 0; i < num_matches; ++i) {
+                int m = first + i;
+                round[m] = Round{r, num_matches * 2, num_matches, i + 1};
+                points[m] = 10 << (num_rounds - 1 - r);
+                num_leaves[m] = 1 << (num_rounds - 1 - r);
+                first_leaf[m] = i * num_leaves[m];
+                if (r == num_rounds - 1) {
+                    first_input[m] = -1;
+                } else {
+                    first_input[m] = previous_first + 2 * i;
+                    output[first_input[m]] = m;
+                    output[first_input[m] + 1] = m;
+                }
+            }
+            previous_first = first;
+            first += num_matches;
+        }
+        output[num_games - 1] = -1;
+
+        for (int m = num_games - 1; m >= 0; --m) {
+            downstream[m] =
+                (uint64_t(1) << m) | (output[m] >= 0 ? downstream[output[m]] : 0);
+        }
+
+        array<int, num_games> subtree_points{};
+        int total_points = 0;
+        for (int m = 0; m < num_games; ++m) {
+            subtree_points[m] = points[m] / 10;
+            if (first_input[m] >= 0) {
+                subtree_points[m] += subtree_points[first_input[m]] +
+                                     subtree_points[first_input[m] + 1];
+            }
+            total_points += points[m] / 10;
+        }
+        for (int m = 0; m < num_games; ++m) {
+            slack[m] = total_points - subtree_points[m];
+        }
+    }
+};
+
+constexpr Topology<NUM_TEAMS> topology;
+static_assert(topology.num_games == NUM_GAMES &&
+              topology.num_rounds == NUM_ROUNDS);
+static_assert(topology.first_input[32] == 0 && topology.output[61] == 62 &&
+              topology.round[48].round == 3 && topology.points[62] == 320);
+
+// match is one based, i.e. goes from 1 .. 63.
+constexpr Round round_index(int match) {
     assert(1 <= match && match <= NUM_GAMES);
-    // For x > 0, bit_width(x) == 1 + floor(log2(x)).
-    int round = bit_width((uint8_t)(64 - match)) - 1;
-    int num_matches = (1 << round);
-    int num_teams = num_matches * 2;
-    return Round{round, num_teams, num_matches, num_teams - (64 - match)};
+    return topology.round[match - 1];
 }
 
-// Index is one based, i.e. goes from 1 .. 32 for Round Of 64.
-int match(int round, int index) {
-    assert(index >= 1);
-    return index + 64 - (1 << (round + 1));
+constexpr int input(int index) {
+    assert(topology.first_input[index] >= 0);
+    return topology.first_input[index];
 }
 
-int input(int index) {
-    Round round_details = round_index(index + 1);
-    int inputRound = round_details.round + 1;  // + 1 for previous round.
-    int inputRoundIndex = round_details.index * 2 - 1;
-    return match(inputRound, inputRoundIndex) - 1;
-}
+// The inverse of input(): the match that the winner of this one goes on to.
+// -1 for the championship.
+constexpr int output(int index) { return topology.output[index]; }
 
-array<int, NUM_GAMES> points_per_match{
-    // Round of 64
-    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
-    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
-    // Round of 32
-    20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,
-    // Sweet 16
-    40, 40, 40, 40, 40, 40, 40, 40,
-    // Elite 8
-    80, 80, 80, 80,
-    // Final 4
-    160, 160,
-    // Championship
-    320};
+constexpr const array<int, NUM_GAMES> &points_per_match = topology.points;
 
 const array<const string, NUM_ROUNDS> round_names{
     "Champ", "Final4", "Elite8", "Sweet16", "Roundof32", "Roundof64",
@@ -590,8 +1990,35 @@ unordered_map<game_t, string> INDEX_TO_NAME{
 
 // This should probably be a simple class, rather than a typedef.  Oh well.
 using scoretuple_t = uint64_t;  // For more than 8 players, need uint128_t.
-static_assert(sizeof(scoretuple_t) >= NUM_BRACKETS);
+static_assert(sizeof(scoretuple_t) >= MAX_BRACKETS);
+
+// The functions that loop over the bytes of a scoretuple_t are templated on
+// the number of brackets, so the loops are unrolled for the size of the pool
+// we're looking at.  with_num_brackets() picks the right one at runtime.
+template <typename F>
+decltype(auto) with_num_brackets(size_t num_brackets, F &&func) {
+    static_assert(MAX_BRACKETS == 8);
+    switch (num_brackets) {
+        case 2:
+            return func.template operator()<2>();
+        case 3:
+            return func.template operator()<3>();
+        case 4:
+            return func.template operator()<4>();
+        case 5:
+            return func.template operator()<5>();
+        case 6:
+            return func.template operator()<6>();
+        case 7:
+            return func.template operator()<7>();
+        case 8:
+            return func.template operator()<8>();
+    }
+    throw runtime_error(fmt::format("Need between 2 and {} brackets, got {}.",
+                                    MAX_BRACKETS, num_brackets));
+}
 
+template <size_t NumBrackets>
 pair<int, int> winner(scoretuple_t scores) {
     const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&scores);
 
@@ -599,7 +2026,7 @@ pair<int, int> winner(scoretuple_t scores) {
     int biggest_index = 0;
     uint8_t second_biggest = 0;
     int second_biggest_index = -1;
-    for (size_t i = 1; i < NUM_BRACKETS; i++) {
+    for (size_t i = 1; i < NumBrackets; i++) {
         if (bytes[i] > biggest) {
             second_biggest = biggest;
             second_biggest_index = biggest_index;
@@ -614,28 +2041,81 @@ pair<int, int> winner(scoretuple_t scores) {
     return make_pair(biggest_index, second_biggest_index);
 }
 
+template <size_t NumBrackets>
 scoretuple_t normalize(scoretuple_t input) {
     scoretuple_t result = input;
     uint8_t *bytes = reinterpret_cast<uint8_t *>(&result);
     uint8_t smallest = bytes[0];
-    for (size_t i = 1; i < NUM_BRACKETS; i++) {
+    for (size_t i = 1; i < NumBrackets; i++) {
         if (bytes[i] < smallest) {
             smallest = bytes[i];
         }
     }
 
-    for (size_t i = 0; i < NUM_BRACKETS; i++) {
+    for (size_t i = 0; i < NumBrackets; i++) {
         bytes[i] -= smallest;
     }
 
     return result;
 }
 
-string make_string(scoretuple_t scores) {
+// For the results of match: the most points, in units of 10, that any bracket
+// can still gain on any other, from the games outside match's subtree.
+constexpr int slack_after(game_t match) { return topology.slack[match]; }
+
+// normalize(), and then some.  All we care about in the end is who comes
+// first and second, so:
+// - A gap between brackets bigger than slack can never close, so it might as
+//   well be slack + 1.
+// - A bracket that two others are out of reach of can't finish first or
+//   second, so its score doesn't matter at all.
+// After the championship, slack is 0, and all that's left is the order.
+template <size_t NumBrackets>
+scoretuple_t compress(scoretuple_t input, int slack) {
+    scoretuple_t result = normalize<NumBrackets>(input);
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(&result);
+    uint8_t biggest = 0;
+    for (size_t i = 0; i < NumBrackets; i++) {
+        biggest = max(biggest, bytes[i]);
+    }
+    if (biggest <= slack) {
+        return result;
+    }
+
+    // Indexes of brackets, lowest score first.
+    array<uint8_t, NumBrackets> order;
+    for (size_t i = 0; i < NumBrackets; i++) {
+        size_t j = i;
+        for (; j > 0 && bytes[order[j - 1]] > bytes[i]; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    uint8_t prev = 0;
+    uint8_t compressed = 0;
+    for (size_t i = 1; i < NumBrackets; i++) {
+        uint8_t score = bytes[order[i]];
+        compressed += min(score - prev, slack + 1);
+        prev = score;
+        bytes[order[i]] = compressed;
+    }
+
+    uint8_t second_biggest = bytes[order[NumBrackets - 2]];
+    for (size_t i = 0; i < NumBrackets - 2; i++) {
+        if (second_biggest - bytes[order[i]] > slack) {
+            bytes[order[i]] = 0;
+        }
+    }
+
+    return result;
+}
+
+string make_string(scoretuple_t scores, size_t num_brackets = MAX_BRACKETS) {
     const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&scores);
     string result = "(";
     bool first = true;
-    for (size_t i = 0; i < NUM_BRACKETS; i++) {
+    for (size_t i = 0; i < num_brackets; i++) {
         if (!first) {
             result += ", ";
         }
@@ -685,6 +2165,96 @@ struct Bracket {
     vector<team_t> picks;
 };
 
+// Picks transposed: for each match, byte i is bracket i's pick.  That way the
+// score tuple for a match's winner is a handful of 64-bit ops, rather than a
+// loop over brackets.  Unused bytes are 0xff, which never matches a team.
+class PickMatrix {
+   public:
+    explicit PickMatrix(const vector<Bracket> &brackets) {
+        assert(brackets.size() <= MAX_BRACKETS);
+        by_match_.fill(~uint64_t{0});
+        for (size_t i = 0; i < brackets.size(); ++i) {
+            set_picks(i, brackets[i].picks);
+        }
+    }
+
+    void set_picks(size_t bracket, const vector<team_t> &picks) {
+        assert(picks.size() == NUM_GAMES);
+        for (size_t match = 0; match < NUM_GAMES; ++match) {
+            reinterpret_cast<uint8_t *>(&by_match_[match])[bracket] =
+                picks[match];
+        }
+    }
+
+    // reduced_points in each byte whose bracket picked team to win match, 0
+    // elsewhere.
+    uint64_t scoretuple(game_t match, team_t team,
+                        uint8_t reduced_points) const {
+        constexpr uint64_t ones = 0x0101010101010101;
+        constexpr uint64_t low7 = 0x7f7f7f7f7f7f7f7f;
+        uint64_t diff = by_match_[match] ^ (ones * (uint8_t)team);
+        // High bit set in exactly the bytes where diff is zero.
+        uint64_t zero = ~(((diff & low7) + low7) | diff | low7);
+        return (zero >> 7) * reduced_points;
+    }
+
+    team_t pick(size_t bracket, game_t match) const {
+        return reinterpret_cast<const int8_t *>(&by_match_[match])[bracket];
+    }
+
+   private:
+    array<uint64_t, NUM_GAMES> by_match_;
+};
+
+// The score tuple for every (match, winner), so outcomes() just looks it up.
+// Built once per set of brackets.  When an optimizer tries new picks for one
+// entry, set_picks() only touches the two teams per match whose tuples change.
+class ScoreTable {
+   public:
+    explicit ScoreTable(const vector<Bracket> &brackets)
+        : picks_(brackets), num_brackets_(brackets.size()) {
+        for (game_t match = 0; match < NUM_GAMES; ++match) {
+            for (team_t team = 0; team < NUM_TEAMS; ++team) {
+                recompute(match, team);
+            }
+        }
+    }
+
+    void set_picks(size_t bracket, const vector<team_t> &picks) {
+        array<team_t, NUM_GAMES> old_picks;
+        for (game_t match = 0; match < NUM_GAMES; ++match) {
+            old_picks[match] = picks_.pick(bracket, match);
+        }
+        picks_.set_picks(bracket, picks);
+        for (game_t match = 0; match < NUM_GAMES; ++match) {
+            if (old_picks[match] != picks[match]) {
+                recompute(match, old_picks[match]);
+                recompute(match, picks[match]);
+            }
+        }
+    }
+
+    scoretuple_t operator()(game_t match, team_t team) const {
+        return by_match_[match][team];
+    }
+
+    size_t num_brackets() const {
+        return num_brackets_;
+    }
+
+   private:
+    void recompute(game_t match, team_t team) {
+        if (team >= 0) {
+            by_match_[match][team] = picks_.scoretuple(
+                match, team, points_per_match[match] / 10);
+        }
+    }
+
+    PickMatrix picks_;
+    size_t num_brackets_;
+    array<array<scoretuple_t, NUM_TEAMS>, NUM_GAMES> by_match_;
+};
+
 // vector<Bracket> brackets;
 
 string to_string(const Bracket &bracket) {
@@ -705,7 +2275,7 @@ Bracket make_bracket(const array<bool, NUM_GAMES> &who_wins,
     Bracket bracket;
     bracket.name = name;
     for (game_t match = 0; match < NUM_GAMES; ++match) {
-        if (match < 32) {
+        if (topology.first_input[match] < 0) {
             // Base case: round of 64.
             bracket.picks.push_back(match * 2 + (who_wins[match] ? 0 : 1));
         } else {
@@ -724,10 +2294,10 @@ pair<Bracket, array<bool, NUM_GAMES>> make_most_likely_bracket() {
     array<bool, NUM_GAMES> choices;
 
     for (game_t match = 0; match < NUM_GAMES; ++match) {
-        int round = round_index(match + 1).round;
+        int round = topology.round[match].round;
         team_t first_team;
         team_t second_team;
-        if (match < 32) {
+        if (topology.first_input[match] < 0) {
             first_team = games[match].first_team;
             second_team = games[match].second_team;
         } else {
@@ -770,8 +2340,6 @@ void compare(const Bracket &bracket1, const Bracket &bracket2) {
     }
 }
 
-vector<bitset<NUM_TEAMS>> all_selections(NUM_GAMES);
-
 string to_string(const bitset<NUM_TEAMS> selections) {
     string result;
     bool first = true;
@@ -808,14 +2376,6 @@ Bracket get_bracket(uint64_t entry) {
     return result;
 }
 
-void make_all_selections(const vector<Bracket> &brackets) {
-    for (int i = 0; i < NUM_GAMES; i++) {
-        for (const auto &bracket : brackets) {
-            all_selections[i].set(bracket.picks[i]);
-        }
-    }
-}
-
 /**********  Boolean Expressions, for "paths of glory"  **********/
 
 #if WITH_BOOLEXPR
@@ -1224,31 +2784,129 @@ shared_ptr<BoolExpr> and_(unordered_set<shared_ptr<BoolExpr>> children) {
 
 #endif  // WITH_BOOLEXPR
 
-/**********  Outcomes  **********/
+/**********  Profiling  **********/
+
+#if WITH_PROFILE
+// Everything is counted per thread, with no locking or atomics in the hot
+// loops, and added to the process-wide totals when the thread exits.
+struct Profile {
+    struct Match {
+        uint64_t calls = 0;
+        // Only this match's own work, not the games feeding into it.
+        uint64_t nanos = 0;
+        uint64_t result_sets = 0;
+        // Calls to BasicOutcomes::update(), i.e. hash table insertions or
+        // combinations with an existing entry.
+        uint64_t inserts = 0;
+        uint64_t mc_draws = 0;
+        // Peak resident set size of the process so far, when a call to this
+        // match finished.
+        long max_rss_kb = 0;
+    };
+    array<Match, NUM_GAMES> matches;
+    // Distributor: how long workers waited to get the next candidate, and
+    // the main thread to get the next result.
+    uint64_t get_work_nanos = 0;
+    uint64_t get_result_nanos = 0;
+
+    void add(const Profile &other) {
+        for (game_t m = 0; m < NUM_GAMES; ++m) {
+            Match &match = matches[m];
+            const Match &theirs = other.matches[m];
+            match.calls += theirs.calls;
+            match.nanos += theirs.nanos;
+            match.result_sets += theirs.result_sets;
+            match.inserts += theirs.inserts;
+            match.mc_draws += theirs.mc_draws;
+            match.max_rss_kb = max(match.max_rss_kb, theirs.max_rss_kb);
+        }
+        get_work_nanos += other.get_work_nanos;
+        get_result_nanos += other.get_result_nanos;
+    }
+};
 
-scoretuple_t get_scoretuple(game_t match_index, team_t winning_team,
-                            uint8_t reduced_points,
-                            const vector<Bracket> &brackets) {
-    scoretuple_t scores{0};
+mutex profile_mutex;
+Profile profile_totals;
 
-    uint8_t *bytes = reinterpret_cast<uint8_t *>(&scores);
+struct ThreadProfile : Profile {
+    ~ThreadProfile() {
+        scoped_lock lock(profile_mutex);
+        profile_totals.add(*this);
+    }
+};
 
-    for (size_t i = 0; i < brackets.size(); i++) {
-        if (brackets[i].picks[match_index] == winning_team) {
-            bytes[i] = reduced_points;
-        }
+thread_local ThreadProfile profile;
+
+uint64_t profile_nanos() {
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+        .count();
+}
+
+long max_rss_kb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Call at the end of outcomes_for(), with when its own work started.
+template <typename Outcomes>
+void profile_match(game_t match, uint64_t start, const Outcomes &result) {
+    Profile::Match &counters = profile.matches[match];
+    counters.calls++;
+    counters.nanos += profile_nanos() - start;
+    for (const auto &outcome : result) {
+        counters.result_sets += outcome.result_sets.size();
     }
+    counters.max_rss_kb = max(counters.max_rss_kb, max_rss_kb());
+}
 
-    return scores;
+// Called at exit, once every thread, main included, has added its counters
+// in.  One line per round, then the Distributor's waits.
+void print_profile() {
+    scoped_lock lock(profile_mutex);
+    const Profile &totals = profile_totals;
+
+    cerr << fmt::format("{:<10} {:>9} {:>10} {:>13} {:>13} {:>13} {:>10}\n",
+                        "round", "calls", "sec", "result_sets", "inserts",
+                        "mc_draws", "max_rss_mb");
+    for (game_t first = 0; first < NUM_GAMES;) {
+        const auto ri = round_index(first + 1);
+        Profile::Match round;
+        for (game_t m = first; m < first + ri.num_matches; ++m) {
+            const Profile::Match &match = totals.matches[m];
+            round.calls += match.calls;
+            round.nanos += match.nanos;
+            round.result_sets += match.result_sets;
+            round.inserts += match.inserts;
+            round.mc_draws += match.mc_draws;
+            round.max_rss_kb = max(round.max_rss_kb, match.max_rss_kb);
+        }
+        cerr << fmt::format("{:<10} {:>9} {:>10.3f} {:>13} {:>13} {:>13} "
+                            "{:>10.1f}\n",
+                            round_names[ri.round], round.calls,
+                            round.nanos / 1e9, round.result_sets, round.inserts,
+                            round.mc_draws, round.max_rss_kb / 1024.0);
+        first += ri.num_matches;
+    }
+    cerr << fmt::format(
+        "Distributor waits: workers for work {:.3f} sec, main thread for "
+        "results {:.3f} sec\n",
+        totals.get_work_nanos / 1e9, totals.get_result_nanos / 1e9);
 }
+#endif  // WITH_PROFILE
 
-struct ResultSet {
-    double prob;
+/**********  Outcomes  **********/
+
+// Prob is double for the usual single scenario, or ProbVec to carry a whole
+// ensemble through outcomes() at once.
+template <typename Prob>
+struct BasicResultSet {
+    Prob prob;
 #if WITH_BOOLEXPR
     shared_ptr<BoolExpr> which;
 #endif
 
-    void combine_disjoint(const ResultSet other) {
+    void combine_disjoint(const BasicResultSet other) {
         prob += other.prob;
 #if WITH_BOOLEXPR
         which = or_({which, other.which});
@@ -1256,99 +2914,225 @@ struct ResultSet {
     }
 };
 
+using ResultSet = BasicResultSet<double>;
+
 string to_string(ResultSet result_set) {
     return fmt::format("{:.3f}% ", result_set.prob * 100)
         BOOLEXPR(+to_string(result_set.which));
 }
 
+template <typename Prob>
 struct TeamInfo {
     team_t team;
-    ResultSet result_set;
+    BasicResultSet<Prob> result_set;
 };
 
+template <typename Prob>
 struct Row {
     scoretuple_t scoretuple;
-    ResultSet result_set;
+    // prob here is sample_weight(), not the probability of the row.
+    BasicResultSet<Prob> result_set;
     double cumsum_prob = 0;
 };
 
-struct Outcomes {
+// Monte Carlo samples rows by their mean probability over the scenarios, so
+// each scenario's sample has to be weighted by how far it is from the mean.
+// With a single scenario that's always 1.
+double sample_weight(double) {
+    return 1.0;
+}
+
+ProbVec sample_weight(const ProbVec &prob) {
+    double mean_prob = mean(prob);
+    return mean_prob > 0 ? prob / mean_prob : ProbVec(0);
+}
+
+// One of the teams in a bucket, see BasicOutcomes::members.
+template <typename Prob>
+struct Member {
     team_t team;
-    unordered_map<scoretuple_t, ResultSet> result_sets;
+    Prob prob;
+};
+
+template <typename Prob>
+struct BasicOutcomes {
+    team_t team;
+    pmr::unordered_map<scoretuple_t, BasicResultSet<Prob>> result_sets;
+    // Only for a bucket of teams that score the same from here on, team < 0,
+    // see collapse_unpicked.  For each score tuple in result_sets, which team
+    // it was, with probabilities adding up to the result set's.  Who got here
+    // depends on the scores so far, and decides who wins the next game, so
+    // it's kept per score tuple.
+    pmr::unordered_map<scoretuple_t, pmr::vector<Member<Prob>>> members;
+    // Whether Monte Carlo went into this, in this game or an earlier one.
+    bool monte_carlo = false;
 
    private:
-    // total_prob_ is only used during Monte Carlo.
-    double total_prob_ = 0;
+    // total_prob_ is used during Monte Carlo, and get_win_probs() adds it up
+    // for unaccounted, so it has to stay right in exact mode too, prune()
+    // included.
+    Prob total_prob_ = 0;
     mutable bool frozen_ = false;
-    mutable vector<Row> rows_;
+    mutable pmr::vector<Row<Prob>> rows_;
 
    public:
-    Outcomes(team_t team, scoretuple_t scores, ResultSet set)
-        : team(team), result_sets{{scores, set}}, total_prob_(set.prob) {}
-    Outcomes() : team(-1) {}
-    Outcomes(team_t team) : team(team) {}
-
-    double total_prob() const {
+    // So a pmr::vector<BasicOutcomes> hands its memory resource down to the
+    // maps inside, see ArenaScope.
+    using allocator_type = pmr::polymorphic_allocator<>;
+
+    BasicOutcomes(team_t team, scoretuple_t scores, BasicResultSet<Prob> set,
+                  allocator_type alloc = {})
+        : team(team),
+          result_sets(alloc),
+          members(alloc),
+          total_prob_(set.prob),
+          rows_(alloc) {
+        result_sets.emplace(scores, set);
+    }
+    BasicOutcomes(allocator_type alloc = {})
+        : team(-1), result_sets(alloc), members(alloc), rows_(alloc) {}
+    BasicOutcomes(team_t team, allocator_type alloc = {})
+        : team(team), result_sets(alloc), members(alloc), rows_(alloc) {}
+    BasicOutcomes(const BasicOutcomes &other, allocator_type alloc = {})
+        : team(other.team),
+          result_sets(other.result_sets, alloc),
+          members(other.members, alloc),
+          monte_carlo(other.monte_carlo),
+          total_prob_(other.total_prob_),
+          frozen_(other.frozen_),
+          rows_(other.rows_, alloc) {}
+    BasicOutcomes(BasicOutcomes &&other, allocator_type alloc)
+        : team(other.team),
+          result_sets(std::move(other.result_sets), alloc),
+          members(std::move(other.members), alloc),
+          monte_carlo(other.monte_carlo),
+          total_prob_(other.total_prob_),
+          frozen_(other.frozen_),
+          rows_(std::move(other.rows_), alloc) {}
+    BasicOutcomes(BasicOutcomes &&other) = default;
+    BasicOutcomes &operator=(BasicOutcomes &&other) = default;
+
+    Prob total_prob() const {
         return total_prob_;
     }
 
-    void increment_total_prob(double amount) {
+    void increment_total_prob(Prob amount) {
         assert(!frozen_);
-        if (amount + total_prob_ > 1.0000001) {
+        if (max_lane(amount + total_prob_) > 1.0000001) {
             cout << "total_prob_: " << total_prob_ << ", increment: " << amount
                  << endl;
         }
-        assert(amount + total_prob_ < 1.0000001);
+        assert(max_lane(amount + total_prob_) < 1.0000001);
         total_prob_ += amount;
     }
 
-    const vector<Row> &get_rows() const {
+    // Drops the result sets less likely than epsilon, along with their share
+    // of total_prob().  Returns how much that was.
+    Prob prune(double epsilon) {
+        assert(!frozen_);
+        Prob pruned = 0;
+        erase_if(result_sets, [&](const auto &scores_and_set) {
+            const Prob &prob = scores_and_set.second.prob;
+            if (mean(prob) >= epsilon) {
+                return false;
+            }
+            pruned += prob;
+            members.erase(scores_and_set.first);
+            return true;
+        });
+        total_prob_ = result_sets.empty() ? Prob(0) : total_prob_ - pruned;
+        return pruned;
+    }
+
+    // For a bucket: member got here with prob, and scores.
+    void add_member(scoretuple_t scores, team_t member, Prob prob) {
+        assert(team < 0);
+        pmr::vector<Member<Prob>> &here = members[scores];
+        for (Member<Prob> &existing : here) {
+            if (existing.team == member) {
+                existing.prob += prob;
+                return;
+            }
+        }
+        here.push_back({member, prob});
+    }
+
+    // Fills out with each team that could have got here with scores, and its
+    // weight, weights adding up to 1.
+    void get_members(scoretuple_t scores,
+                     pmr::vector<Member<Prob>> &out) const {
+        out.clear();
+        if (team >= 0) {
+            out.push_back({team, Prob(1.0)});
+            return;
+        }
+        const pmr::vector<Member<Prob>> &here = members.at(scores);
+        Prob total = 0;
+        for (const Member<Prob> &member : here) {
+            total += member.prob;
+        }
+        for (const Member<Prob> &member : here) {
+            out.push_back({member.team, fraction(member.prob, total)});
+        }
+    }
+
+    const pmr::vector<Row<Prob>> &get_rows() const {
         if (!frozen_) {
             double cumsum_prob = 0;
             for (const auto &[scoretuple, result_set] : result_sets) {
-                cumsum_prob += result_set.prob;
+                cumsum_prob += mean(result_set.prob);
                 rows_.push_back({scoretuple, result_set, cumsum_prob});
-                rows_[rows_.size() - 1].result_set.prob = -1;
-            }
-            if (fabs(total_prob() - rows_[rows_.size() - 1].cumsum_prob) >
-                1e-12) {
-                cout << "total_prob: " << total_prob()
-                     << ", computed: " << rows_[rows_.size() - 1].cumsum_prob
-                     << ", diff: "
-                     << total_prob() - rows_[rows_.size() - 1].cumsum_prob
-                     << "\n";
-            }
-            assert(fabs(total_prob() - rows_[rows_.size() - 1].cumsum_prob) <
-                   1e-12);
+                rows_[rows_.size() - 1].result_set.prob =
+                    sample_weight(result_set.prob);
+            }
+            // An ensemble's rows only add up to total_prob() in expectation,
+            // once there's been Monte Carlo upstream.
+            if constexpr (is_same_v<Prob, double>) {
+                // Rounding error grows with the number of rows we added up,
+                // and a bucket can have a lot of them.
+                double tolerance =
+                    1e-12 + rows_.size() * numeric_limits<double>::epsilon();
+                if (fabs(total_prob() - rows_[rows_.size() - 1].cumsum_prob) >
+                    tolerance) {
+                    cout << "total_prob: " << total_prob() << ", computed: "
+                         << rows_[rows_.size() - 1].cumsum_prob << ", diff: "
+                         << total_prob() - rows_[rows_.size() - 1].cumsum_prob
+                         << "\n";
+                }
+                assert(fabs(total_prob() -
+                            rows_[rows_.size() - 1].cumsum_prob) < tolerance);
+            }
             frozen_ = true;
         }
         return rows_;
     }
 
-    void update(const TeamInfo &winner, scoretuple_t this_scores,
-                scoretuple_t total_scores, const ResultSet &result_set1,
-                const ResultSet &result_set2, double probability) {
+    // Returns where it went, for add_member().
+    template <size_t NumBrackets>
+    scoretuple_t update(const TeamInfo<Prob> &winner, scoretuple_t this_scores,
+                        scoretuple_t total_scores,
+                        const BasicResultSet<Prob> &result_set1,
+                        const BasicResultSet<Prob> &result_set2,
+                        Prob probability, int slack) {
         assert(!frozen_);
-        ResultSet new_set;
+        BasicResultSet<Prob> new_set;
 
-        if (winner.team < 0) {
-#if WITH_BOOLEXPR
-            new_set.which = and_({result_set1.which, result_set2.which});
-#endif
-        } else {
 #if WITH_BOOLEXPR
-            new_set.which = and_({result_set1.which, result_set2.which,
-                                  winner.result_set.which});
+        new_set.which = and_(
+            {result_set1.which, result_set2.which, winner.result_set.which});
 #endif
-            total_scores += this_scores;
-        }
+        total_scores += this_scores;
         // This is where I do the "or" with existing results.;
-        ResultSet &rset = result_sets[normalize(total_scores)];
+        scoretuple_t compressed = compress<NumBrackets>(total_scores, slack);
+        BasicResultSet<Prob> &rset = result_sets[compressed];
         new_set.prob = winner.result_set.prob * probability;
         rset.combine_disjoint(new_set);
+        return compressed;
     }
 };
 
+using Outcomes = BasicOutcomes<double>;
+
 string to_string(const Outcomes &outcome) {
     string result;
     result += (outcome.team < 0 ? "other" : teams[outcome.team].name) + ":\n";
@@ -1359,45 +3143,267 @@ string to_string(const Outcomes &outcome) {
     return result;
 }
 
-Outcomes *find_team(vector<Outcomes> &outcomes, team_t team) {
-    for (auto &outcome : outcomes) {
-        if (outcome.team == team) {
-            return &outcome;
-        }
-    }
-    return nullptr;
-}
-
-const Row &random_row(const vector<Row> &rows) {
-    double myrand = rng.uniform() * rows[rows.size() - 1].cumsum_prob;
+// u is uniform in [0, 1).
+template <typename Prob>
+const Row<Prob> &random_row(const pmr::vector<Row<Prob>> &rows, double u) {
+    double myrand = u * rows[rows.size() - 1].cumsum_prob;
 
     // First item where myrand <= item.cumsum_prob
     auto iter = lower_bound(
         rows.begin(), rows.end(), myrand,
-        [](const Row &row, double myrand) { return row.cumsum_prob < myrand; });
+        [](const Row<Prob> &row, double myrand) {
+            return row.cumsum_prob < myrand;
+        });
     assert(iter != rows.end());
 
     return *iter;
 }
 
-// The first element of the vector is always for team "other".
-vector<Outcomes> outcomes(game_t match_index, bitset<64> selections,
-                          const vector<Bracket> &brackets) {
+template <typename Prob>
+const Row<Prob> &random_row(const pmr::vector<Row<Prob>> &rows) {
+    return random_row(rows, rng.uniform());
+}
+
+// Which (first, second) place finish scores have locked in, as first *
+// NumBrackets + second, or -1 if the games outside this subtree (worth slack)
+// could still change it.
+template <size_t NumBrackets>
+int settled_finish(scoretuple_t scores, int slack) {
+    scoretuple_t compressed = compress<NumBrackets>(scores, slack);
+    auto [first, second] = winner<NumBrackets>(compressed);
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&compressed);
+    int third_score = 0;
+    for (size_t i = 0; i < NumBrackets; i++) {
+        if ((int)i != first && (int)i != second) {
+            third_score = max(third_score, (int)bytes[i]);
+        }
+    }
+    if (bytes[first] - bytes[second] > slack &&
+        (NumBrackets == 2 || bytes[second] - third_score > slack)) {
+        return first * NumBrackets + second;
+    }
+    return -1;
+}
+
+// How much sampling the pair of outcomes behind rows1 and rows2 is worth: the
+// chance that two draws from it would finish differently (Gini impurity),
+// estimated from a few draws.  Every unsettled draw counts as a finish of its
+// own.  Pairs where somebody has it locked up come out near 0.
+template <size_t NumBrackets, typename Prob>
+double finish_impurity(const pmr::vector<Row<Prob>> &rows1,
+                       const pmr::vector<Row<Prob>> &rows2, int slack) {
+    constexpr int PILOT_DRAWS = 32;
+    array<int, NumBrackets * NumBrackets> settled{};
+    for (int i = 0; i < PILOT_DRAWS; ++i) {
+        const Row<Prob> &row1 = random_row(rows1);
+        const Row<Prob> &row2 = random_row(rows2);
+        int finish = settled_finish<NumBrackets>(
+            row1.scoretuple + row2.scoretuple, slack);
+        if (finish >= 0) {
+            settled[finish]++;
+        }
+    }
+    double same = 0;
+    for (int count : settled) {
+        same += (double)count * count;
+    }
+    return 1.0 - same / ((double)PILOT_DRAWS * PILOT_DRAWS);
+}
+
+// Draws for one team pair of a Monte Carlo game, worth team_pair_prob of it.
+// Plain Monte Carlo gives every pair its share of config.monte_carlo_iters.
+// With adaptive_mc, pairs get draws in proportion to team_pair_prob *
+// impurity (Neyman allocation, with impurity standing in for the standard
+// deviation), scaled so the game as a whole gets the same number.  Either way
+// each draw is weighted by team_pair_prob / draws, so the result stays
+// unbiased.  Never 0 draws, or the pair's probability would go missing.
+size_t mc_draws(double team_pair_prob, double impurity,
+                double total_weighted_impurity, double total_prob) {
+    double share = team_pair_prob;
+    if (config.adaptive_mc && total_weighted_impurity > 0) {
+        // A floor, in case the pilot draws missed something.
+        share = team_pair_prob * max(impurity, 0.02) * total_prob /
+                total_weighted_impurity;
+    }
+    return max((size_t)(share * config.monte_carlo_iters + 0.5), (size_t)1);
+}
+
+// Memoizes outcomes() by match, for a fixed set of brackets.  When a game's
+// result comes in, only that game and the games downstream of it need to be
+// recomputed; every other subtree is reused.
+template <typename Prob>
+class BasicOutcomesCache {
+   public:
+    const pmr::vector<BasicOutcomes<Prob>> *find(game_t match) const {
+        return by_match_[match] ? &*by_match_[match] : nullptr;
+    }
+
+    const pmr::vector<BasicOutcomes<Prob>> &store(
+        game_t match, pmr::vector<BasicOutcomes<Prob>> &&outcomes) {
+        by_match_[match] = std::move(outcomes);
+        return *by_match_[match];
+    }
+
+    void invalidate(game_t match) {
+        for (uint64_t cone = topology.downstream[match]; cone;
+             cone &= cone - 1) {
+            by_match_[countr_zero(cone)].reset();
+        }
+    }
+
+    void clear() {
+        for (auto &outcomes : by_match_) {
+            outcomes.reset();
+        }
+    }
+
+   private:
+    array<optional<pmr::vector<BasicOutcomes<Prob>>>, NUM_GAMES> by_match_;
+};
+
+using OutcomesCache = BasicOutcomesCache<double>;
+
+template <size_t NumBrackets, typename Prob>
+pmr::vector<BasicOutcomes<Prob>> outcomes_for(game_t match_index,
+                                              const ScoreTable &score_table,
+                                              BasicOutcomesCache<Prob> *cache);
+
+// With collapse_unpicked, which bucket each team that could win match goes
+// in, or -1 for an Outcomes of its own.  Teams share a bucket when every
+// bracket would score the same for them in every game after match, most
+// often because nobody picked any of them to go further.  A team alone in
+// its bucket gets its own Outcomes instead.
+array<int8_t, NUM_TEAMS> buckets_for(game_t match,
+                                     const ScoreTable &score_table) {
+    array<int8_t, NUM_TEAMS> buckets;
+    buckets.fill(-1);
+    if (!config.collapse_unpicked) {
+        return buckets;
+    }
+
+    // What every bracket scores with team winning each game after match.
+    using Future = array<scoretuple_t, NUM_ROUNDS>;
+    array<pair<Future, team_t>, NUM_TEAMS> futures;
+    size_t num_teams = 0;
+    for (int leaf = topology.first_leaf[match];
+         leaf < topology.first_leaf[match] + topology.num_leaves[match];
+         ++leaf) {
+        for (team_t team : {games[leaf].first_team, games[leaf].second_team}) {
+            Future future{};
+            int i = 0;
+            for (int later = output(match); later >= 0; later = output(later)) {
+                future[i++] = score_table(later, team);
+            }
+            futures[num_teams++] = {future, team};
+        }
+    }
+
+    sort(futures.begin(), futures.begin() + num_teams);
+    int8_t num_buckets = 0;
+    for (size_t first = 0, last; first < num_teams; first = last) {
+        last = first + 1;
+        while (last < num_teams &&
+               futures[last].first == futures[first].first) {
+            ++last;
+        }
+        if (last - first > 1) {
+            for (size_t i = first; i < last; ++i) {
+                buckets[futures[i].second] = num_buckets;
+            }
+            ++num_buckets;
+        }
+    }
+    return buckets;
+}
+
+// outcomes(), but using and filling in cache if we have one.  storage is only
+// used when we don't.
+template <size_t NumBrackets, typename Prob>
+const pmr::vector<BasicOutcomes<Prob>> &cached_outcomes_for(
+    game_t match_index, const ScoreTable &score_table,
+    BasicOutcomesCache<Prob> *cache,
+    pmr::vector<BasicOutcomes<Prob>> &storage) {
+    if (!cache) {
+        storage =
+            outcomes_for<NumBrackets, Prob>(match_index, score_table, nullptr);
+        return storage;
+    }
+    if (const pmr::vector<BasicOutcomes<Prob>> *found =
+            cache->find(match_index)) {
+        return *found;
+    }
+    return cache->store(match_index, outcomes_for<NumBrackets, Prob>(
+                                         match_index, score_table, cache));
+}
+
+pmr::vector<Outcomes> outcomes(game_t match_index,
+                               const ScoreTable &score_table,
+                               OutcomesCache *cache = nullptr) {
+    return with_num_brackets(
+        score_table.num_brackets(), [&]<size_t NumBrackets>() {
+            return outcomes_for<NumBrackets, double>(match_index, score_table,
+                                                     cache);
+        });
+}
+
+pmr::vector<Outcomes> outcomes(game_t match_index,
+                               const vector<Bracket> &brackets,
+                               OutcomesCache *cache = nullptr) {
+    return outcomes(match_index, ScoreTable(brackets), cache);
+}
+
+// outcomes() under every scenario in ensemble_probs at once.
+pmr::vector<BasicOutcomes<ProbVec>> ensemble_outcomes(
+    game_t match_index, const vector<Bracket> &brackets) {
+    ScoreTable score_table(brackets);
+    return with_num_brackets(brackets.size(), [&]<size_t NumBrackets>() {
+        return outcomes_for<NumBrackets, ProbVec>(match_index, score_table,
+                                                  nullptr);
+    });
+}
+
+const pmr::vector<Outcomes> &cached_outcomes(game_t match_index,
+                                             const vector<Bracket> &brackets,
+                                             OutcomesCache *cache) {
+    assert(cache);
+    ScoreTable score_table(brackets);
+    return with_num_brackets(
+        brackets.size(),
+        [&]<size_t NumBrackets>() -> const pmr::vector<Outcomes> & {
+            pmr::vector<Outcomes> unused;
+            return cached_outcomes_for<NumBrackets>(match_index, score_table,
+                                                    cache, unused);
+        });
+}
+
+// One element per team that can win match_index, in no particular order.
+// With collapse_unpicked, teams that score the same from here on share one
+// element instead, with team -1, see buckets_for().
+template <size_t NumBrackets, typename Prob>
+pmr::vector<BasicOutcomes<Prob>> outcomes_for(game_t match_index,
+                                              const ScoreTable &score_table,
+                                              BasicOutcomesCache<Prob> *cache) {
+    PROFILE(uint64_t profile_start = profile_nanos());
     const Matchup &game = games[match_index];
     const auto ri = round_index(match_index + 1);
     int this_points = points_per_match[match_index];
+    const array<int8_t, NUM_TEAMS> buckets =
+        buckets_for(match_index, score_table);
+    // Where each bucket's Outcomes is in result, or -1.
+    array<int8_t, NUM_TEAMS> bucket_slots;
+    bucket_slots.fill(-1);
     if (ri.round == NUM_ROUNDS - 1) {
         // Base case, round of 64.
         assert(this_points == 10);
-        vector<Outcomes> result(1);
-        vector<TeamInfo> teams_with_probs;
+        pmr::vector<BasicOutcomes<Prob>> result(ArenaScope::resource());
+        pmr::vector<TeamInfo<Prob>> teams_with_probs(ArenaScope::resource());
         if (game.winner >= 0) {
             teams_with_probs.push_back({game.winner, {1.0 BOOLEXPR(COMMA{})}});
         } else {
             assert(game.first_team >= 0);
             assert(game.second_team >= 0);
-            double prob_first = game_prob(game.first_team, game.second_team,
-                                          game.first_team, ri.round);
+            Prob prob_first = game_prob_for<Prob>(
+                game.first_team, game.second_team, game.first_team, ri.round);
             teams_with_probs.push_back(
                 {game.first_team,
                  {prob_first BOOLEXPR(COMMA Var::all_vars[game.id].first)}});
@@ -1407,36 +3413,113 @@ vector<Outcomes> outcomes(game_t match_index, bitset<64> selections,
                   prob_first BOOLEXPR(COMMA Var::all_vars[game.id].second)}});
         }
 
-        for (const TeamInfo &team_with_prob : teams_with_probs) {
-            auto scores = get_scoretuple(match_index, team_with_prob.team,
-                                         this_points / 10, brackets);
+        for (const TeamInfo<Prob> &team_with_prob : teams_with_probs) {
+            auto scores = score_table(match_index, team_with_prob.team);
             assert(team_with_prob.team >= 0);
 
-            if (true /* selections[team_with_prob.team] */) {
+            int8_t bucket = buckets[team_with_prob.team];
+            if (bucket < 0) {
                 result.emplace_back(team_with_prob.team, scores,
                                     team_with_prob.result_set);
             } else {
-                result[0].result_sets[scores].prob +=
-                    team_with_prob.result_set.prob;
+                if (bucket_slots[bucket] < 0) {
+                    bucket_slots[bucket] = result.size();
+                    result.emplace_back(-1);
+                }
+                BasicOutcomes<Prob> &other = result[bucket_slots[bucket]];
+                other.result_sets[scores].combine_disjoint(
+                    team_with_prob.result_set);
+                other.increment_total_prob(team_with_prob.result_set.prob);
+                other.add_member(scores, team_with_prob.team,
+                                 team_with_prob.result_set.prob);
             }
         }
 
+        PROFILE(profile.matches[match_index].inserts +=
+                teams_with_probs.size());
+        PROFILE(profile_match(match_index, profile_start, result));
         return result;
     }
 
     // General case.  Start by recursing.
     int prev_match = input(match_index);
-    const auto outcomes1 =
-        outcomes(prev_match, all_selections[match_index], brackets);
-    const auto outcomes2 =
-        outcomes(prev_match + 1, all_selections[match_index], brackets);
+    pmr::vector<BasicOutcomes<Prob>> storage1(ArenaScope::resource());
+    pmr::vector<BasicOutcomes<Prob>> storage2(ArenaScope::resource());
+    const auto &outcomes1 = cached_outcomes_for<NumBrackets>(
+        prev_match, score_table, cache, storage1);
+    const auto &outcomes2 = cached_outcomes_for<NumBrackets>(
+        prev_match + 1, score_table, cache, storage2);
+    // Only count our own work.
+    PROFILE(profile_start = profile_nanos());
 
     size_t threshold_per_team_pairs =
-        MONTE_CARLO_THRESHOLD / (double)(outcomes1.size() * outcomes2.size());
+        config.monte_carlo_threshold /
+        (double)(outcomes1.size() * outcomes2.size());
+    auto use_monte_carlo = [&](const BasicOutcomes<Prob> &outcome1,
+                               const BasicOutcomes<Prob> &outcome2) {
+        return outcome1.result_sets.size() * outcome2.result_sets.size() >
+               threshold_per_team_pairs;
+    };
+
+    // With adaptive_mc, a first pass to see which team pairs are worth
+    // sampling, see mc_draws().  Whoever wins this game, it's settled if
+    // it's settled with this game's points still up for grabs.
+    pmr::vector<double> impurities(ArenaScope::resource());
+    double total_weighted_impurity = 0;
+    double total_mc_prob = 0;
+    if (config.adaptive_mc) {
+        impurities.resize(outcomes1.size() * outcomes2.size());
+        for (size_t i1 = 0; i1 < outcomes1.size(); ++i1) {
+            for (size_t i2 = 0; i2 < outcomes2.size(); ++i2) {
+                const auto &outcome1 = outcomes1[i1];
+                const auto &outcome2 = outcomes2[i2];
+                if (outcome1.result_sets.empty() ||
+                    outcome2.result_sets.empty() ||
+                    !use_monte_carlo(outcome1, outcome2)) {
+                    continue;
+                }
+                double &impurity = impurities[i1 * outcomes2.size() + i2];
+                impurity = finish_impurity<NumBrackets>(
+                    outcome1.get_rows(), outcome2.get_rows(),
+                    slack_after(match_index) + this_points / 10);
+                double team_pair_prob =
+                    mean(outcome1.total_prob()) * mean(outcome2.total_prob());
+                total_weighted_impurity +=
+                    team_pair_prob * max(impurity, 0.02);
+                total_mc_prob += team_pair_prob;
+            }
+        }
+    }
 
     // auto start = now();
 
-    vector<Outcomes> result(1);
+    pmr::vector<BasicOutcomes<Prob>> result(ArenaScope::resource());
+    // Every team in a bucket below goes to the same place here, so this is
+    // as many as we can need, and dest_for()'s references stay good.
+    result.reserve(outcomes1.size() + outcomes2.size());
+    // Where each team's Outcomes is in result, or -1.
+    array<int8_t, NUM_TEAMS> slots;
+    slots.fill(-1);
+    const int slack = slack_after(match_index);
+
+    // Where results with team winning this game go.
+    auto dest_for = [&](team_t team) -> BasicOutcomes<Prob> & {
+        bool own_slot = buckets[team] < 0;
+        int8_t &slot = own_slot ? slots[team] : bucket_slots[buckets[team]];
+        if (slot < 0) {
+            slot = result.size();
+            result.emplace_back(own_slot ? team : -1);
+        }
+        return result[slot];
+    };
+
+    // Probability that team1 beats team2 in this game.
+    auto beats = [&](team_t team1, team_t team2) -> Prob {
+        if (game.winner >= 0) {
+            return team1 == game.winner ? 1.0 : 0.0;
+        }
+        return game_prob_for<Prob>(team1, team2, team1, ri.round);
+    };
 
     /*
     if (ri.round <= 1)
@@ -1445,40 +3528,186 @@ vector<Outcomes> outcomes(game_t match_index, bitset<64> selections,
     }
     */
 
+    // Scratch space for the buckets, see play below.
+    pmr::vector<Member<Prob>> members1(ArenaScope::resource());
+    pmr::vector<Member<Prob>> members2(ArenaScope::resource());
+    pmr::vector<Member<Prob>> winning(ArenaScope::resource());
+
     bool displayed_mc_warning = false;
+    bool monte_carlo = false;
+    for (const auto *outcomes : {&outcomes1, &outcomes2}) {
+        for (const BasicOutcomes<Prob> &outcome : *outcomes) {
+            monte_carlo = monte_carlo || outcome.monte_carlo;
+        }
+    }
     // double rows_elapsed = 0;
     // double mc_iters_elapsed = 0;
 
-    for (const Outcomes &outcome1 : outcomes1) {
+    // Calls visit(scoretuple1, result_set1, scoretuple2, result_set2,
+    // probability) for every pair of result sets from outcomes1[i1] and
+    // outcomes2[i2], or with Monte Carlo, for a sample of them, probability
+    // being what the pair stands for.
+    auto for_each_pair = [&](size_t i1, size_t i2, auto &&visit) {
+        const BasicOutcomes<Prob> &outcome1 = outcomes1[i1];
+        const BasicOutcomes<Prob> &outcome2 = outcomes2[i2];
+        if (use_monte_carlo(outcome1, outcome2)) {
+            if (!displayed_mc_warning) {
+                // cout << "Warning: Round " << round_names[ri.round] <<
+                // " using Monte Carlo simulation, results
+                // approximate.\n";
+                displayed_mc_warning = true;
+            }
+            monte_carlo = true;
+            double team_pair_prob =
+                mean(outcome1.total_prob()) * mean(outcome2.total_prob());
+            size_t monte_carlo_iters = mc_draws(
+                team_pair_prob,
+                config.adaptive_mc ? impurities[i1 * outcomes2.size() + i2]
+                                   : 1.0,
+                total_weighted_impurity, total_mc_prob);
+
+            // auto rows_start = now();
+            const pmr::vector<Row<Prob>> &rows1 = outcome1.get_rows();
+            const pmr::vector<Row<Prob>> &rows2 = outcome2.get_rows();
+            // rows_elapsed += elapsed(rows_start, now());
+
+            // With sobol, draw i is the i-th point of a fresh Sobol2.
+            // Otherwise with adaptive_mc, a Latin hypercube: draw i comes
+            // from the i-th slice of rows1 and the order[i]-th of rows2.
+            const bool sobol = config.mc_sampling == "sobol";
+            const Sobol2 sobol_points(sobol ? rng.uint64() : 0);
+            pmr::vector<uint32_t> order(ArenaScope::resource());
+            if (config.adaptive_mc && !sobol) {
+                order.resize(monte_carlo_iters);
+                iota(order.begin(), order.end(), 0);
+                for (size_t i = order.size(); i > 1; --i) {
+                    swap(order[i - 1], order[rng.uint64() % i]);
+                }
+            }
+            auto draw = [&](size_t i) -> pair<double, double> {
+                if (sobol) {
+                    return sobol_points(i);
+                }
+                if (config.adaptive_mc) {
+                    return {(i + rng.uniform()) / monte_carlo_iters,
+                            (order[i] + rng.uniform()) / monte_carlo_iters};
+                }
+                double u1 = rng.uniform();
+                return {u1, rng.uniform()};
+            };
+
+            PROFILE(profile.matches[match_index].inserts += monte_carlo_iters);
+            PROFILE(profile.matches[match_index].mc_draws += monte_carlo_iters);
+
+            // auto mc_iters_start = now();
+            for (size_t i = 0; i < monte_carlo_iters; ++i) {
+                auto [u1, u2] = draw(i);
+                const Row<Prob> &rand_row1 = random_row(rows1, u1);
+                const Row<Prob> &rand_row2 = random_row(rows2, u2);
+                visit(rand_row1.scoretuple, rand_row1.result_set,
+                      rand_row2.scoretuple, rand_row2.result_set,
+                      rand_row1.result_set.prob * rand_row2.result_set.prob *
+                          (team_pair_prob / monte_carlo_iters));
+            }
+            // mc_iters_elapsed += elapsed(mc_iters_start, now());
+        } else {
+            PROFILE(profile.matches[match_index].inserts +=
+                    outcome1.result_sets.size() * outcome2.result_sets.size());
+            for (const auto &[scoretuple1, result_set1] :
+                 outcome1.result_sets) {
+                for (const auto &[scoretuple2, result_set2] :
+                     outcome2.result_sets) {
+                    visit(scoretuple1, result_set1, scoretuple2, result_set2,
+                          result_set1.prob * result_set2.prob);
+                }
+            }
+        }
+    };
+
+    for (size_t i1 = 0; i1 < outcomes1.size(); ++i1) {
+        const BasicOutcomes<Prob> &outcome1 = outcomes1[i1];
         if (outcome1.result_sets.empty()) {
             continue;
         }
-        assert(outcome1.team >= 0);
 
-        for (const Outcomes &outcome2 : outcomes2) {
+        for (size_t i2 = 0; i2 < outcomes2.size(); ++i2) {
+            const BasicOutcomes<Prob> &outcome2 = outcomes2[i2];
             if (outcome2.result_sets.empty()) {
                 continue;
             }
-            assert(outcome2.team >= 0);
 
-            vector<TeamInfo> teams_with_probs;
+            if (outcome1.team < 0 || outcome2.team < 0) {
+                // Who's playing depends on the scores so far, so each pair of
+                // result sets has its own chances of who wins.
+                auto play = [&](scoretuple_t scoretuple1,
+                                const BasicResultSet<Prob> &result_set1,
+                                scoretuple_t scoretuple2,
+                                const BasicResultSet<Prob> &result_set2,
+                                Prob probability) {
+                    outcome1.get_members(scoretuple1, members1);
+                    outcome2.get_members(scoretuple2, members2);
+                    auto side = [&](const pmr::vector<Member<Prob>> &winners,
+                                    const pmr::vector<Member<Prob>> &losers) {
+                        // Each of winners' chances of being here and winning.
+                        winning.clear();
+                        Prob total = 0;
+                        for (const Member<Prob> &winner : winners) {
+                            Prob prob = 0;
+                            for (const Member<Prob> &loser : losers) {
+                                prob += loser.prob *
+                                        beats(winner.team, loser.team);
+                            }
+                            prob = prob * winner.prob;
+                            total += prob;
+                            winning.push_back({winner.team, prob});
+                        }
+                        if (max_lane(total) == 0) {
+                            return;
+                        }
+                        // They were lumped together for scoring the same from
+                        // here on, so one update does for all of them.
+                        team_t team = winners[0].team;
+                        BasicOutcomes<Prob> &dest = dest_for(team);
+                        dest.increment_total_prob(total * probability);
+                        scoretuple_t scores =
+                            dest.template update<NumBrackets>(
+                                {team, {total BOOLEXPR(COMMA{})}},
+                                score_table(match_index, team),
+                                scoretuple1 + scoretuple2, result_set1,
+                                result_set2, probability, slack);
+                        if (dest.team >= 0) {
+                            return;
+                        }
+                        for (const Member<Prob> &member : winning) {
+                            assert(buckets[member.team] == buckets[team]);
+                            if (max_lane(member.prob) != 0) {
+                                dest.add_member(scores, member.team,
+                                                member.prob * probability);
+                            }
+                        }
+                    };
+                    side(members1, members2);
+                    side(members2, members1);
+                };
+                for_each_pair(i1, i2, play);
+                continue;
+            }
+
+            pmr::vector<TeamInfo<Prob>> teams_with_probs(
+                ArenaScope::resource());
             if (game.winner >= 0) {
                 // If this game has been played in real life, then all previous
                 // games have also been played, so our recursive outcomes had
                 // better have only a single non-empty result.
-                assert(outcomes1.size() == 1 ||
-                       (outcomes1.size() == 2 &&
-                        outcomes1[0].result_sets.empty()));
-                assert(outcomes2.size() == 1 ||
-                       (outcomes2.size() == 2 &&
-                        outcomes2[0].result_sets.empty()));
+                assert(outcomes1.size() == 1);
+                assert(outcomes2.size() == 1);
                 assert(game.winner == outcome1.team ||
                        game.winner == outcome2.team);
                 teams_with_probs.push_back(
                     {game.winner, {1.0 BOOLEXPR(COMMA{})}});
             } else {
-                double prob_first = game_prob(outcome1.team, outcome2.team,
-                                              outcome1.team, ri.round);
+                Prob prob_first = game_prob_for<Prob>(
+                    outcome1.team, outcome2.team, outcome1.team, ri.round);
                 teams_with_probs.push_back(
                     {outcome1.team,
                      {prob_first BOOLEXPR(
@@ -1489,71 +3718,34 @@ vector<Outcomes> outcomes(game_t match_index, bitset<64> selections,
                                 COMMA Var::all_vars[match_index].second)}});
             }
 
-            // So if both are "other", do we even need to loop over two winners?
-            // Since the scores will be exactly the same either way?
             for (const auto &winner : teams_with_probs) {
                 assert(winner.team >= 0);
-                // Find the destination spot in result
-                Outcomes *dest;
-                if (false /* winner < 0 || !selections[winner] */) {
-                    dest = &result[0];
-                } else {
-                    dest = find_team(result, winner.team);
-                    if (!dest) {
-                        result.emplace_back(winner.team);
-                        dest = &result[result.size() - 1];
-                    }
-                }
+                BasicOutcomes<Prob> *dest = &dest_for(winner.team);
 
                 dest->increment_total_prob(winner.result_set.prob *
                                            outcome1.total_prob() *
                                            outcome2.total_prob());
 
-                auto this_scores = get_scoretuple(match_index, winner.team,
-                                                  this_points / 10, brackets);
-
-                if (outcome1.result_sets.size() * outcome2.result_sets.size() >
-                    threshold_per_team_pairs) {
-                    if (!displayed_mc_warning) {
-                        // cout << "Warning: Round " << round_names[ri.round] <<
-                        // " using Monte Carlo simulation, results
-                        // approximate.\n";
-                        displayed_mc_warning = true;
-                    }
-                    double team_pair_prob =
-                        outcome1.total_prob() * outcome2.total_prob();
-                    size_t monte_carlo_iters =
-                        max((size_t)(team_pair_prob * MONTE_CARLO_ITERS + 0.5),
-                            (size_t)1);
-
-                    // auto rows_start = now();
-                    const vector<Row> &rows1 = outcome1.get_rows();
-                    const vector<Row> &rows2 = outcome2.get_rows();
-                    // rows_elapsed += elapsed(rows_start, now());
-
-                    // auto mc_iters_start = now();
-                    for (size_t i = 0; i < monte_carlo_iters; ++i) {
-                        const Row &rand_row1 = random_row(rows1);
-                        const Row &rand_row2 = random_row(rows2);
-                        dest->update(
-                            winner, this_scores,
-                            rand_row1.scoretuple + rand_row2.scoretuple,
-                            rand_row1.result_set, rand_row2.result_set,
-                            team_pair_prob / monte_carlo_iters);
-                    }
-                    // mc_iters_elapsed += elapsed(mc_iters_start, now());
-                } else {
-                    for (const auto &[scoretuple1, result_set1] :
-                         outcome1.result_sets) {
-                        for (const auto &[scoretuple2, result_set2] :
-                             outcome2.result_sets) {
-                            dest->update(winner, this_scores,
-                                         scoretuple1 + scoretuple2, result_set1,
-                                         result_set2,
-                                         result_set1.prob * result_set2.prob);
-                        }
-                    }
-                }
+                auto this_scores = score_table(match_index, winner.team);
+
+                for_each_pair(i1, i2,
+                              [&](scoretuple_t scoretuple1,
+                                  const BasicResultSet<Prob> &result_set1,
+                                  scoretuple_t scoretuple2,
+                                  const BasicResultSet<Prob> &result_set2,
+                                  Prob probability) {
+                                  scoretuple_t scores =
+                                      dest->template update<NumBrackets>(
+                                          winner, this_scores,
+                                          scoretuple1 + scoretuple2,
+                                          result_set1, result_set2,
+                                          probability, slack);
+                                  if (dest->team < 0) {
+                                      dest->add_member(
+                                          scores, winner.team,
+                                          winner.result_set.prob * probability);
+                                  }
+                              });
             }
         }
     }
@@ -1572,36 +3764,82 @@ vector<Outcomes> outcomes(game_t match_index, bitset<64> selections,
     }
     */
 
+    for (BasicOutcomes<Prob> &outcome : result) {
+        outcome.monte_carlo = monte_carlo;
+    }
+
+    if (config.prune_epsilon > 0) {
+        for (BasicOutcomes<Prob> &outcome : result) {
+            outcome.prune(config.prune_epsilon);
+        }
+    }
+
+    PROFILE(profile_match(match_index, profile_start, result));
     return result;
 }
 
-struct WinProb {
+template <typename Prob>
+struct BasicWinProb {
     int bracket;
-    ResultSet first_place;
-    ResultSet second_place;
+    BasicResultSet<Prob> first_place;
+    BasicResultSet<Prob> second_place;
+    // Probability of the outcomes pruned away, see prune_epsilon.  The same
+    // for every bracket.  Without Monte Carlo, its real chance of first (or
+    // second) place is somewhere between first_place.prob and
+    // first_place.prob + unaccounted.  With it, sampling error can be bigger
+    // than that, so it's no bound at all, see has_error_bound().
+    Prob unaccounted = 0;
+    // Whether Monte Carlo went into these, anywhere in the tournament.
+    bool monte_carlo = false;
 };
 
-vector<WinProb> get_win_probs(const vector<Outcomes> &outcomes) {
-    vector<WinProb> win_probs(NUM_BRACKETS);
+using WinProb = BasicWinProb<double>;
 
-    for (size_t i = 0; i < NUM_BRACKETS; ++i) {
+template <typename Prob>
+vector<BasicWinProb<Prob>> get_win_probs(
+    const pmr::vector<BasicOutcomes<Prob>> &outcomes, size_t num_brackets) {
+    vector<BasicWinProb<Prob>> win_probs(num_brackets);
+
+    for (size_t i = 0; i < num_brackets; ++i) {
         win_probs[i].bracket = i;
     }
 
-    for (const Outcomes &outc : outcomes) {
-        for (const auto &score_and_result_sets : outc.result_sets) {
-            auto [biggest_index, second_biggest_index] =
-                winner(score_and_result_sets.first);
-            win_probs[biggest_index].first_place.combine_disjoint(
-                score_and_result_sets.second);
-            win_probs[second_biggest_index].second_place.combine_disjoint(
-                score_and_result_sets.second);
+    Prob accounted = 0;
+    bool monte_carlo = false;
+    with_num_brackets(num_brackets, [&]<size_t NumBrackets>() {
+        for (const BasicOutcomes<Prob> &outc : outcomes) {
+            accounted += outc.total_prob();
+            monte_carlo = monte_carlo || outc.monte_carlo;
+            for (const auto &score_and_result_sets : outc.result_sets) {
+                auto [biggest_index, second_biggest_index] =
+                    winner<NumBrackets>(score_and_result_sets.first);
+                win_probs[biggest_index].first_place.combine_disjoint(
+                    score_and_result_sets.second);
+                win_probs[second_biggest_index].second_place.combine_disjoint(
+                    score_and_result_sets.second);
+            }
+        }
+    });
+
+    for (BasicWinProb<Prob> &win_prob : win_probs) {
+        win_prob.monte_carlo = monte_carlo;
+        // Without pruning this is only rounding error.
+        if (config.prune_epsilon > 0) {
+            win_prob.unaccounted = 1.0 - accounted;
         }
     }
 
     return win_probs;
 }
 
+// Whether win_probs' unaccounted is worth reporting: there was pruning, and
+// no Monte Carlo for it to leave out of the picture.
+template <typename Prob>
+bool has_error_bound(const vector<BasicWinProb<Prob>> &win_probs) {
+    return config.prune_epsilon > 0 && !win_probs.empty() &&
+           !win_probs[0].monte_carlo;
+}
+
 team_t must_win(game_t match_index, int bracket,
                 const vector<Bracket> &brackets) {
     Matchup &matchup = games[match_index];
@@ -1609,7 +3847,7 @@ team_t must_win(game_t match_index, int bracket,
 
     matchup.winner = matchup.first_team;
     assert(matchup.winner >= 0);
-    auto win_probs = get_win_probs(outcomes(62, {}, brackets));
+    auto win_probs = get_win_probs(outcomes(62, brackets), brackets.size());
     if (win_probs[bracket].first_place.prob == 0) {
         matchup.winner = original_winner;
         return matchup.second_team;
@@ -1617,7 +3855,7 @@ team_t must_win(game_t match_index, int bracket,
 
     matchup.winner = matchup.second_team;
     assert(matchup.winner >= 0);
-    win_probs = get_win_probs(outcomes(62, {}, brackets));
+    win_probs = get_win_probs(outcomes(62, brackets), brackets.size());
     if (win_probs[bracket].first_place.prob == 0) {
         matchup.winner = original_winner;
         return matchup.first_team;
@@ -1695,6 +3933,720 @@ void alternatives(int bracket_to_consider,
     }
 }
 
+/**********  Live updates  **********/
+
+// Every entry page has the teams and the matchups, including results so far.
+// Returns the games whose teams or winner changed, which is all of them the
+// first time.
+vector<game_t> load_tournament(const string &html) {
+    const auto teams_json =
+        get_json("espn.fantasy.maxpart.config.scoreboard_teams", html);
+    assert(teams_json.size() == NUM_TEAMS);
+    for (const auto &team : teams_json) {
+        int id = team["id"].get<int>() - 1;
+        teams[id].name = team["n"];
+        teams[id].abbrev = team["a"];
+        eid_to_team[team["eid"].get<int>()] = id;
+    }
+
+    const auto matchups_json =
+        get_json("espn.fantasy.maxpart.config.scoreboard_matchups", html);
+
+    assert(matchups_json.size() == NUM_GAMES);
+    vector<game_t> changed;
+    for (const auto &matchup : matchups_json) {
+        Matchup m = parse_matchup(matchup);
+        const Matchup &old = games[m.id];
+        if (old.id != m.id || old.first_team != m.first_team ||
+            old.second_team != m.second_team || old.winner != m.winner) {
+            changed.push_back(m.id);
+        }
+        games[m.id] = m;
+#if WITH_BOOLEXPR
+        if (m.winner < 0) {
+            const string &rname = round_names[round_index(m.id + 1).round];
+            const string first_name =
+                (m.first_team < 0 ? to_string(m.id) + "first"
+                                  : teams[m.first_team].abbrev);
+            const string second_name =
+                (m.second_team < 0 ? to_string(m.id) + "second"
+                                   : teams[m.second_team].abbrev);
+            Var::all_vars[m.id] = make_pair(
+                make_shared<Var>(first_name + "-" + rname, m.id, true),
+                make_shared<Var>(second_name + "-" + rname, m.id, false));
+        }
+#endif
+    }
+
+    return changed;
+}
+
+json win_probs_entries(const vector<WinProb> &win_probs,
+                       const vector<Bracket> &brackets) {
+    json entries = json::array();
+    for (const WinProb &win_prob : win_probs) {
+        entries.push_back({{"name", brackets[win_prob.bracket].name},
+                           {"first_place", win_prob.first_place.prob},
+                           {"second_place", win_prob.second_place.prob}});
+    }
+    return entries;
+}
+
+string win_probs_json(const vector<WinProb> &win_probs,
+                      const vector<Bracket> &brackets) {
+    json j;
+    j["updated_at"] = unix_now();
+    j["snapshot"] = page_cache.snapshot_id(input_urls());
+    j["games_played"] = count_if(games.begin(), games.end(),
+                                 [](const Matchup &m) { return m.winner >= 0; });
+    j["entries"] = win_probs_entries(win_probs, brackets);
+    if (has_error_bound(win_probs)) {
+        j["unaccounted"] = win_probs[0].unaccounted;
+    }
+    return j.dump(4) + "\n";
+}
+
+// Runs forever: every poll_interval seconds, revalidates the first entry's
+// page (for results) and the 538 forecasts.  When a game finishes, only the
+// Outcomes for that game and the games downstream of it are recomputed, so
+// the new win & second place probabilities come out within seconds.  They're
+// printed, and written to <year>/live.json for anything else that's watching.
+//
+// New 538 forecasts change every game's probabilities, so they recompute
+// everything.
+void live_update(const vector<Bracket> &brackets, double poll_interval) {
+    assert(config.cache_max_age >= 0);
+
+    OutcomesCache cache;
+    string forecasts_object;
+    for (bool first = true;; first = false) {
+        if (!first) {
+            this_thread::sleep_for(duration<double>(poll_interval));
+            page_cache.expire_run_checks();
+        }
+
+        Fetcher fetcher(2);
+        fetcher.add(entry_url(config.entries[0]),
+                    entry_fpath(config.entries[0]));
+        fetcher.add(forecasts_url(), forecasts_fpath());
+        if (fetcher.run() == 0 && !first) {
+            continue;
+        }
+
+        auto start = now();
+        vector<game_t> changed =
+            load_tournament(page_cache.body(entry_url(config.entries[0])));
+        string new_forecasts_object = page_cache.meta(forecasts_url())->object;
+        if (new_forecasts_object != forecasts_object) {
+            forecasts_object = new_forecasts_object;
+            parse_probs();
+            cache.clear();
+        }
+        for (game_t match : changed) {
+            cache.invalidate(match);
+        }
+
+        auto win_probs =
+            get_win_probs(cached_outcomes(NUM_GAMES - 1, brackets, &cache),
+                          brackets.size());
+
+        time_t now_time_t = system_clock::to_time_t(system_clock::now());
+        cout << "\n***** " << ctime(&now_time_t) << changed.size()
+             << " games changed, recomputed in " << elapsed(start, now())
+             << " sec.\n";
+        for (const WinProb &win_prob : win_probs) {
+            cout << fmt::format("{:<22}: {:5.2f}% {:5.2f}%\n",
+                                brackets[win_prob.bracket].name,
+                                win_prob.first_place.prob * 100,
+                                win_prob.second_place.prob * 100);
+        }
+        if (has_error_bound(win_probs)) {
+            cout << fmt::format("Pruned: each could be up to {:.4f}% higher\n",
+                                win_probs[0].unaccounted * 100);
+        }
+        write_cache_atomically(config.year + "/live.json",
+                               win_probs_json(win_probs, brackets));
+        if (event_log) {
+            event_log->emit({{"type", "win_probs"},
+                             {"games_changed", changed.size()},
+                             {"entries", win_probs_entries(win_probs, brackets)}});
+        }
+    }
+}
+
+/**********  Query service  **********/
+
+// Keeps the tournament, the brackets and the cached Outcomes in memory, and
+// answers questions about them over HTTP on 127.0.0.1, instead of us editing
+// main() and recompiling for every "what if".  E.g.:
+//
+//   ./a.out --when before-elite8 --query 8539 &
+//   curl 'http://127.0.0.1:8539/win_probs'
+//   curl 'http://127.0.0.1:8539/games'
+//   curl 'http://127.0.0.1:8539/what_if?56=Gonzaga&58=Villanova'
+//   curl 'http://127.0.0.1:8539/compare?a=0&b=Tara'
+//
+// Everything comes back as JSON.  A what-if only invalidates the cached
+// Outcomes downstream of the games it forces, so the rest of the tree is
+// reused and answers come back in well under a second after the first.
+
+string url_decode(const string &source) {
+    string result;
+    for (size_t i = 0; i < source.size(); ++i) {
+        if (source[i] == '+') {
+            result += ' ';
+        } else if (source[i] == '%' && i + 2 < source.size()) {
+            result += char(stoi(source.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            result += source[i];
+        }
+    }
+    return result;
+}
+
+// "/what_if?53=Villanova&60=Gonzaga" -> {"/what_if", {{"53", "Villanova"},
+// {"60", "Gonzaga"}}}
+pair<string, vector<pair<string, string>>> parse_target(const string &target) {
+    size_t question = target.find('?');
+    vector<pair<string, string>> params;
+    if (question != string::npos) {
+        for (const string &param : split(target.substr(question + 1), '&')) {
+            size_t equals = param.find('=');
+            if (equals == string::npos) {
+                throw runtime_error("Expected name=value, got " + param);
+            }
+            params.emplace_back(url_decode(param.substr(0, equals)),
+                                url_decode(param.substr(equals + 1)));
+        }
+    }
+    return {target.substr(0, question), params};
+}
+
+team_t find_team(const string &name) {
+    auto same = [&](const string &other) {
+        return equal(name.begin(), name.end(), other.begin(), other.end(),
+                     [](char a, char b) { return tolower(a) == tolower(b); });
+    };
+    for (team_t team = 0; team < NUM_TEAMS; ++team) {
+        if (same(teams[team].name) || same(teams[team].abbrev)) {
+            return team;
+        }
+    }
+    throw runtime_error("Unknown team: " + name);
+}
+
+class QueryService {
+   public:
+    explicit QueryService(const vector<Bracket> &brackets)
+        : brackets_(brackets) {}
+
+    HttpResponse handle(const vector<string> &request_line) {
+        HttpResponse reply;
+        reply.content_type = "application/json";
+        json body;
+        auto start = now();
+        try {
+            if (request_line.size() != 3 || request_line[0] != "GET") {
+                throw runtime_error("Only GET is supported.");
+            }
+            auto [path, params] = parse_target(request_line[1]);
+            lock_guard<mutex> lock(mutex_);
+            if (path == "/win_probs") {
+                body = {{"entries", entries(current_win_probs())}};
+            } else if (path == "/games") {
+                body = {{"games", games_json()}};
+            } else if (path == "/what_if") {
+                body = what_if(params);
+            } else if (path == "/compare") {
+                body = compare_json(params);
+            } else {
+                reply.status = 404;
+                body = {{"error", "Unknown query: " + path}};
+            }
+        } catch (const exception &e) {
+            reply.status = 400;
+            body = {{"error", e.what()}};
+        }
+        body["elapsed"] = elapsed(start, now());
+        reply.body = body.dump(4) + "\n";
+
+        cout << "Query " << reply.status << " "
+             << (request_line.size() > 1 ? request_line[1] : "?") << " in "
+             << body["elapsed"].get<double>() << " sec." << endl;
+        return reply;
+    }
+
+   private:
+    vector<WinProb> current_win_probs() {
+        return get_win_probs(cached_outcomes(NUM_GAMES - 1, brackets_, &cache_),
+                             brackets_.size());
+    }
+
+    json entries(const vector<WinProb> &win_probs) {
+        json result = win_probs_entries(win_probs, brackets_);
+        if (has_error_bound(win_probs)) {
+            for (json &entry : result) {
+                entry["unaccounted"] = win_probs[0].unaccounted;
+            }
+        }
+        return result;
+    }
+
+    json team_json(team_t team) {
+        return team >= 0 ? json(teams[team].name) : json(nullptr);
+    }
+
+    json games_json() {
+        json result = json::array();
+        for (const Matchup &game : games) {
+            result.push_back(
+                {{"game", game.id},
+                 {"round", round_names[round_index(game.id + 1).round]},
+                 {"first_team", team_json(game.first_team)},
+                 {"second_team", team_json(game.second_team)},
+                 {"winner", team_json(game.winner)}});
+        }
+        return result;
+    }
+
+    // The two teams playing in match, given the results in trial, or -1 for
+    // a side that isn't decided yet.
+    static pair<team_t, team_t> teams_in(const vector<Matchup> &trial,
+                                         game_t match) {
+        if (topology.first_input[match] < 0) {
+            return {trial[match].first_team, trial[match].second_team};
+        }
+        return {trial[input(match)].winner, trial[input(match) + 1].winner};
+    }
+
+    // Forces each game in params (game index = team) to be won by that
+    // team, in game order, and compares the win probabilities with the real
+    // ones.  Outcomes assumes a game with a winner has everything before it
+    // played too, so a game can only be forced once both its teams are
+    // known, really or by an earlier forced game.
+    json what_if(const vector<pair<string, string>> &params) {
+        if (params.empty()) {
+            throw runtime_error("what_if needs at least one game=team.");
+        }
+        map<game_t, team_t> forced;
+        for (const auto &[game_str, team_name] : params) {
+            int match = stoi(game_str);
+            if (match < 0 || match >= NUM_GAMES) {
+                throw runtime_error("No such game: " + game_str);
+            }
+            forced[match] = find_team(team_name);
+        }
+
+        vector<Matchup> trial = games;
+        json result;
+        for (const auto &[match, team] : forced) {
+            auto [first, second] = teams_in(trial, match);
+            if (trial[match].winner >= 0 && trial[match].winner != team) {
+                throw runtime_error(fmt::format("{} already won game {}.",
+                                                teams[trial[match].winner].name,
+                                                match));
+            }
+            if (first < 0 || second < 0) {
+                throw runtime_error(fmt::format(
+                    "Game {}'s teams aren't known yet, force games {} and {} "
+                    "first.",
+                    match, input(match), input(match) + 1));
+            }
+            if (team != first && team != second) {
+                throw runtime_error(
+                    fmt::format("{} isn't playing in game {}, {} and {} are.",
+                                teams[team].name, match, teams[first].name,
+                                teams[second].name));
+            }
+            trial[match].winner = team;
+            result["forced"].push_back(
+                {{"game", match}, {"winner", teams[team].name}});
+        }
+
+        vector<WinProb> before = current_win_probs();
+
+        swap(games, trial);
+        for (const auto &[match, team] : forced) {
+            cache_.invalidate(match);
+        }
+        vector<WinProb> after = current_win_probs();
+        swap(games, trial);
+        for (const auto &[match, team] : forced) {
+            cache_.invalidate(match);
+        }
+
+        result["entries"] = entries(after);
+        for (size_t i = 0; i < after.size(); ++i) {
+            result["entries"][i]["first_place_change"] =
+                after[i].first_place.prob - before[i].first_place.prob;
+        }
+        return result;
+    }
+
+    // An entry by its index in config.entries, or by name.
+    int find_bracket(const vector<pair<string, string>> &params,
+                     const string &key) {
+        for (const auto &[name, value] : params) {
+            if (name != key) {
+                continue;
+            }
+            for (size_t i = 0; i < brackets_.size(); ++i) {
+                if (brackets_[i].name == value || std::to_string(i) == value) {
+                    return i;
+                }
+            }
+            throw runtime_error("Unknown entry: " + value);
+        }
+        throw runtime_error("compare needs " + key + "=<entry>.");
+    }
+
+    // Where two entries differ, and how many points are still riding on
+    // those games.
+    json compare_json(const vector<pair<string, string>> &params) {
+        int a = find_bracket(params, "a");
+        int b = find_bracket(params, "b");
+        const Bracket &bracket_a = brackets_[a];
+        const Bracket &bracket_b = brackets_[b];
+        vector<WinProb> win_probs = current_win_probs();
+
+        json result = {
+            {"a", {{"name", bracket_a.name},
+                   {"first_place", win_probs[a].first_place.prob},
+                   {"second_place", win_probs[a].second_place.prob}}},
+            {"b", {{"name", bracket_b.name},
+                   {"first_place", win_probs[b].first_place.prob},
+                   {"second_place", win_probs[b].second_place.prob}}},
+            {"differences", json::array()}};
+        int points_at_stake = 0;
+        for (game_t match = 0; match < NUM_GAMES; ++match) {
+            if (bracket_a.picks[match] == bracket_b.picks[match]) {
+                continue;
+            }
+            result["differences"].push_back(
+                {{"game", match},
+                 {"round", round_names[round_index(match + 1).round]},
+                 {"points", points_per_match[match]},
+                 {"a", team_json(bracket_a.picks[match])},
+                 {"b", team_json(bracket_b.picks[match])},
+                 {"winner", team_json(games[match].winner)}});
+            if (games[match].winner < 0) {
+                points_at_stake += points_per_match[match];
+            }
+        }
+        result["points_at_stake"] = points_at_stake;
+        return result;
+    }
+
+    const vector<Bracket> &brackets_;
+    // Guards games, which what_if() changes while it works, and cache_.
+    mutex mutex_;
+    OutcomesCache cache_;
+};
+
+// Runs forever.
+void run_query_service(const vector<Bracket> &brackets, int port) {
+    QueryService service(brackets);
+    int listen_fd = listen_on_loopback(port);
+    cout << "Answering queries on http://127.0.0.1:" << port << endl;
+    for (;;) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        thread(serve_http, fd,
+               [&service](const vector<string> &request_line, const string &) {
+                   return service.handle(request_line);
+               })
+            .detach();
+    }
+}
+
+/**********  Batch mode  **********/
+
+// Evaluates each pool of entries in jobs, spread over all cores.
+vector<vector<WinProb>> evaluate_jobs(
+    const vector<vector<uint64_t>> &jobs,
+    const unordered_map<uint64_t, Bracket> &bracket_for_entry) {
+    vector<vector<WinProb>> job_results(jobs.size());
+    vector<exception_ptr> errors(jobs.size());
+    atomic<size_t> next_job{0};
+    auto worker = [&]() {
+        for (size_t job; (job = next_job++) < jobs.size();) {
+            try {
+                vector<Bracket> brackets;
+                for (auto entry : jobs[job]) {
+                    brackets.push_back(bracket_for_entry.at(entry));
+                }
+                job_results[job] = get_win_probs(
+                    outcomes(NUM_GAMES - 1, brackets), brackets.size());
+            } catch (...) {
+                errors[job] = current_exception();
+            }
+        }
+    };
+    vector<thread> workers;
+    size_t num_threads =
+        min((size_t)max(thread::hardware_concurrency(), 1u), jobs.size());
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (auto &thread : workers) {
+        thread.join();
+    }
+    for (const auto &error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+
+    return job_results;
+}
+
+// Evaluates many pools, possibly from different years or phases of the
+// tournament, in one process.  The batch file is JSON:
+//
+//   {"runs": [{"year": "2022", "when_run": "before-sweet16",
+//              "pools": [{"name": "Family", "entries": [60122219, ...]},
+//                        ...]},
+//             ...]}
+//
+// year and when_run default to the ones in config.  A run can also have
+// "models": ["538", "bradley-terry", ...], to evaluate every pool under each
+// probability model.
+//
+// Each run's pages are fetched together, and its tournament and 538 forecasts
+// are loaded once.  Each bracket is parsed once no matter how many pools it's
+// in, and pools with exactly the same entries are only evaluated once.  Pools
+// are spread over all cores.  The results for everything are a single JSON
+// document.
+json evaluate_run(const json &run) {
+    vector<uint64_t> all_entries;
+    vector<pair<string, vector<uint64_t>>> pools;
+    for (const auto &pool : run["pools"]) {
+        auto entries = pool["entries"].get<vector<uint64_t>>();
+        for (auto entry : entries) {
+            if (find(all_entries.begin(), all_entries.end(), entry) ==
+                all_entries.end()) {
+                all_entries.push_back(entry);
+            }
+        }
+        pools.emplace_back(pool.value("name", ""), std::move(entries));
+    }
+    if (all_entries.empty()) {
+        throw runtime_error("Batch run with no entries.");
+    }
+
+    prefetch(all_entries, config.max_in_flight);
+    load_tournament(get_entry(all_entries[0]));
+    parse_probs();
+
+    unordered_map<uint64_t, Bracket> bracket_for_entry;
+    for (auto entry : all_entries) {
+        bracket_for_entry[entry] = get_bracket(entry);
+    }
+
+    // Pools with identical entries share a job.
+    map<vector<uint64_t>, size_t> job_for_entries;
+    vector<vector<uint64_t>> jobs;
+    for (const auto &[name, entries] : pools) {
+        if (job_for_entries.emplace(entries, jobs.size()).second) {
+            jobs.push_back(entries);
+        }
+    }
+
+    json result;
+    result["year"] = config.year;
+    result["when_run"] = config.when_run;
+    result["pools"] = json::array();
+    // Every model's tables were built by parse_probs(), so an ensemble is
+    // just re-running the jobs with each one.
+    for (const auto &model :
+         run.value("models", vector<string>{config.prob_model})) {
+        use_prob_model(model);
+        auto job_results = evaluate_jobs(jobs, bracket_for_entry);
+        for (const auto &[name, entries] : pools) {
+            json pool;
+            pool["name"] = name;
+            pool["model"] = model;
+            pool["entries"] = json::array();
+            const auto &win_probs = job_results[job_for_entries[entries]];
+            for (const WinProb &win_prob : win_probs) {
+                const Bracket &bracket =
+                    bracket_for_entry[entries[win_prob.bracket]];
+                pool["entries"].push_back(
+                    {{"entry", entries[win_prob.bracket]},
+                     {"name", bracket.name},
+                     {"first_place", win_prob.first_place.prob},
+                     {"second_place", win_prob.second_place.prob}});
+            }
+            if (has_error_bound(win_probs)) {
+                pool["unaccounted"] = win_probs[0].unaccounted;
+            }
+            result["pools"].push_back(std::move(pool));
+        }
+    }
+    use_prob_model(config.prob_model);
+    return result;
+}
+
+void run_batch(const string &fpath, const string &output_fpath) {
+    auto raw = read_file(fpath);
+    if (!raw) {
+        throw runtime_error("Couldn't read batch file " + fpath);
+    }
+
+    auto start = now();
+    const Config saved = config;
+    json output;
+    output["runs"] = json::array();
+    const json batch = json::parse(*raw);
+    for (const auto &run : batch["runs"]) {
+        config.year = run.value("year", saved.year);
+        config.when_run = run.value("when_run", saved.when_run);
+        output["runs"].push_back(evaluate_run(run));
+    }
+    config = saved;
+    output["elapsed"] = elapsed(start, now());
+
+    if (output_fpath.empty()) {
+        cout << output.dump(4) << "\n";
+    } else {
+        write_cache_atomically(output_fpath, output.dump(4) + "\n");
+    }
+}
+
+/**********  Ensemble  **********/
+
+// How much does each bracket's chance depend on 538 being right?  Evaluates
+// the pool under ENSEMBLE_SIZE probability scenarios, see make_ensemble(), in
+// a single pass of outcomes().  Scenario 0 is the unperturbed snapshot.
+void run_ensemble(const vector<Bracket> &brackets, double sigma,
+                  uint64_t seed) {
+    make_ensemble(sigma, seed);
+
+    auto start = now();
+    auto win_probs =
+        get_win_probs(ensemble_outcomes(62, brackets), brackets.size());
+    cout << fmt::format("{} scenarios, sigma {}, seed {}, {:.3f} sec\n",
+                        ENSEMBLE_SIZE, sigma, seed, elapsed(start, now()));
+
+    cout << fmt::format("{:<22}  {:>7} {:>7} {:>7} {:>7}\n", "", "538",
+                        "mean", "min", "max");
+    for (const auto &win_prob : win_probs) {
+        const ProbVec &first = win_prob.first_place.prob;
+        double lowest = first[0];
+        for (size_t i = 1; i < ENSEMBLE_SIZE; ++i) {
+            lowest = min(lowest, first[i]);
+        }
+        cout << fmt::format("{:<22}: {:6.2f}% {:6.2f}% {:6.2f}% {:6.2f}%\n",
+                            brackets[win_prob.bracket].name, first[0] * 100,
+                            mean(first) * 100, lowest * 100,
+                            max_lane(first) * 100);
+    }
+}
+
+/**********  Monte Carlo error  **********/
+
+// How far off is Monte Carlo?  Runs outcomes() replicates times, each with its
+// own random numbers, and prints each bracket's mean chance of first place with
+// a 95% confidence interval for it, plus the standard deviation of a single
+// run, which is what an ordinary run is off by.  The interval uses the normal
+// approximation, so ask for 10 or more.
+void run_replicates(const vector<Bracket> &brackets, int replicates) {
+    vector<double> sum(brackets.size()), sum_squares(brackets.size());
+    auto start = now();
+    for (int r = 0; r < replicates; ++r) {
+        for (const WinProb &win_prob : get_win_probs(
+                 outcomes(NUM_GAMES - 1, brackets), brackets.size())) {
+            double prob = win_prob.first_place.prob;
+            sum[win_prob.bracket] += prob;
+            sum_squares[win_prob.bracket] += prob * prob;
+        }
+    }
+    cout << fmt::format("{} replicates, {} iters{}, {:.3f} sec\n", replicates,
+                        config.monte_carlo_iters,
+                        config.adaptive_mc ? " (adaptive)" : "",
+                        elapsed(start, now()));
+
+    cout << fmt::format("{:<22}  {:>7} {:>8} {:>8}\n", "", "mean", "95% CI",
+                        "1 run");
+    for (size_t i = 0; i < brackets.size(); ++i) {
+        double mean_prob = sum[i] / replicates;
+        double variance = max(sum_squares[i] / replicates - mean_prob * mean_prob,
+                              0.0) *
+                          replicates / (replicates - 1);
+        double sd = sqrt(variance);
+        cout << fmt::format("{:<22}: {:6.2f}% +-{:5.2f}% +-{:5.2f}%\n",
+                            brackets[i].name, mean_prob * 100,
+                            1.96 * sd / sqrt(replicates) * 100, sd * 100);
+    }
+}
+
+// Which Monte Carlo settings are good enough?  Computes the pool exactly, then
+// for each sampling mode and a range of iters, replicates Monte Carlo runs and
+// prints how far they are from exact: the root mean square error over all
+// brackets' chances of first place, the worst single error, and how often the
+// brackets came out in the same order as exact.  The order is what the
+// optimizer's choices depend on.  Only Monte Carlo where config says so, i.e.
+// lower --mc-threshold to exercise it in a round where exact is affordable.
+void run_convergence(const vector<Bracket> &brackets, int replicates) {
+    const Config saved = config;
+    auto order = [](const vector<WinProb> &win_probs) {
+        vector<int> result(win_probs.size());
+        iota(result.begin(), result.end(), 0);
+        stable_sort(result.begin(), result.end(), [&](int a, int b) {
+            return win_probs[a].first_place.prob >
+                   win_probs[b].first_place.prob;
+        });
+        return result;
+    };
+
+    // Not numeric_limits<size_t>::max(), outcomes_for() divides it by a
+    // double and converts back.
+    config.monte_carlo_threshold = size_t(1) << 60;
+    auto start = now();
+    auto exact = get_win_probs(outcomes(NUM_GAMES - 1, brackets),
+                               brackets.size());
+    cout << fmt::format("exact, {:.3f} sec\n", elapsed(start, now()));
+    auto exact_order = order(exact);
+
+    cout << fmt::format("{:<16} {:>9} {:>9} {:>9} {:>7} {:>9}\n", "sampling",
+                        "iters", "rms", "max", "order", "sec/run");
+    for (string sampling : {"random", "sobol"}) {
+        for (bool adaptive : {false, true}) {
+            for (size_t iters : {1'000, 10'000, 100'000}) {
+                config = saved;
+                config.mc_sampling = sampling;
+                config.adaptive_mc = adaptive;
+                config.monte_carlo_iters = iters;
+                double sum_squares = 0;
+                double worst = 0;
+                int same_order = 0;
+                auto start = now();
+                for (int r = 0; r < replicates; ++r) {
+                    auto win_probs = get_win_probs(
+                        outcomes(NUM_GAMES - 1, brackets), brackets.size());
+                    for (size_t i = 0; i < brackets.size(); ++i) {
+                        double error = win_probs[i].first_place.prob -
+                                       exact[i].first_place.prob;
+                        sum_squares += error * error;
+                        worst = max(worst, fabs(error));
+                    }
+                    same_order += order(win_probs) == exact_order;
+                }
+                cout << fmt::format(
+                    "{:<16} {:>9} {:8.4f}% {:8.4f}% {:>3}/{:<3} {:9.3f}\n",
+                    sampling + (adaptive ? "+adaptive" : ""), iters,
+                    sqrt(sum_squares / (replicates * brackets.size())) * 100,
+                    worst * 100, same_order, replicates,
+                    elapsed(start, now()) / replicates);
+            }
+        }
+    }
+    config = saved;
+}
+
 /**********  Probablity of winning  **********/
 
 // 25.09% chance of success.
@@ -1728,20 +4680,29 @@ string to_string(const array<bool, NUM_GAMES> &choices) {
     return result + "}";
 }
 
+// score_table has everybody else's picks.  Only entry's get replaced, so an
+// optimizer trying one variation after another should hang on to its table.
 double prob_win(const array<bool, NUM_GAMES> &choices, int entry,
-                const vector<Bracket> &orig_brackets) {
-    vector<Bracket> brackets{orig_brackets};
+                ScoreTable &score_table) {
+    score_table.set_picks(entry, make_bracket(choices).picks);
 
-    brackets[entry] = make_bracket(choices);
-    // make_all_selections(brackets);
+    // Everything outcomes() allocates is gone as soon as we have win_probs.
+    thread_local Arena arena;
+    ArenaScope arena_scope(arena);
 
-    auto results = outcomes(NUM_GAMES - 1, {}, brackets);
+    auto results = outcomes(NUM_GAMES - 1, score_table);
 
-    auto win_probs = get_win_probs(results);
+    auto win_probs = get_win_probs(results, score_table.num_brackets());
 
     return win_probs[entry].first_place.prob;
 }
 
+double prob_win(const array<bool, NUM_GAMES> &choices, int entry,
+                const vector<Bracket> &brackets) {
+    ScoreTable score_table(brackets);
+    return prob_win(choices, entry, score_table);
+}
+
 // Actually, maybe we don't want this.  Maybe each worker thread, when it's
 // done, can just call an update function on its own thread, before it gets more
 // work.  That probably makes the most sense.  Oh well.
@@ -1801,6 +4762,41 @@ class ProducerConsumerQueue {
     queue<optional<T>> queue_;
 };
 
+// Choices as a string of 0s and 1s, one per match.  Smaller than JSON's
+// array of booleans.
+string choices_string(const array<bool, NUM_GAMES> &choices) {
+    string result;
+    for (bool choice : choices) {
+        result += choice ? '1' : '0';
+    }
+    return result;
+}
+
+array<bool, NUM_GAMES> parse_choices(const string &str) {
+    if (str.size() != NUM_GAMES) {
+        throw runtime_error("Bad choices in checkpoint: " + str);
+    }
+    array<bool, NUM_GAMES> result;
+    for (game_t match = 0; match < NUM_GAMES; ++match) {
+        result[match] = str[match] == '1';
+    }
+    return result;
+}
+
+// One candidate an optimizer tried, for the event log.
+void log_candidate(const string &optimizer, const string &description,
+                   const array<bool, NUM_GAMES> &choices, double prob,
+                   bool new_best) {
+    if (event_log) {
+        event_log->emit({{"type", "candidate"},
+                         {"optimizer", optimizer},
+                         {"description", description},
+                         {"choices", choices_string(choices)},
+                         {"prob", prob},
+                         {"new_best", new_best}});
+    }
+}
+
 struct Stuff {
     array<bool, NUM_GAMES> choices;
     string description;
@@ -1838,14 +4834,21 @@ class Distributor {
     }
 
     optional<Stuff> get_result() {
-        return queue_.consume();
+        PROFILE(uint64_t start = profile_nanos());
+        optional<Stuff> result = queue_.consume();
+        PROFILE(profile.get_result_nanos += profile_nanos() - start);
+        return result;
     }
 
     pair<array<bool, NUM_GAMES>, double> loop(double best_prob) {
         array<bool, NUM_GAMES> best_choices;
         while (optional<Stuff> stuff = get_result()) {
-            cout << stuff->description << ", prob: " << stuff->prob * 100
-                 << "%\n";
+            log_candidate("distributor", stuff->description, stuff->choices,
+                          stuff->prob, stuff->prob > best_prob);
+            if (!event_log) {
+                cout << stuff->description << ", prob: " << stuff->prob * 100
+                     << "%\n";
+            }
             if (stuff->prob > best_prob) {
                 cout << "*****  New best!\n";
                 best_choices = stuff->choices;
@@ -1861,18 +4864,22 @@ class Distributor {
 
    private:
     optional<Stuff> get_work() {
+        PROFILE(uint64_t start = profile_nanos());
         scoped_lock mylock(generator_mutex_);
+        PROFILE(profile.get_work_nanos += profile_nanos() - start);
         return generator_->get();
     }
 
     void worker() {
+        ScoreTable score_table(brackets);
         for (;;) {
             optional<Stuff> work = get_work();
             if (!work) {
                 queue_.producer_done();
                 return;
             }
-            double prob = prob_win(work->choices, entry_to_optimize_, brackets);
+            double prob =
+                prob_win(work->choices, entry_to_optimize_, score_table);
             work->prob = prob;
             queue_.produce(move(*work));
         }
@@ -1904,13 +4911,19 @@ pair<array<bool, NUM_GAMES>, double> single_optimize(
     array<bool, NUM_GAMES> best_choices, double best_prob,
     int entry_to_optimize, game_t first_match,
     const vector<Bracket> &brackets) {
+    ScoreTable score_table(brackets);
     for (game_t match = first_match; match < NUM_GAMES; ++match) {
         array<bool, NUM_GAMES> this_choices = best_choices;
         this_choices[match] = !this_choices[match];
 
-        double prob = prob_win(this_choices, entry_to_optimize, brackets);
-        cout << "prob after flipping match " << (int)match << " is "
-             << prob * 100 << "%\n";
+        double prob = prob_win(this_choices, entry_to_optimize, score_table);
+        log_candidate("single_optimize",
+                      "Flipping match " + to_string((int)match), this_choices,
+                      prob, prob > best_prob);
+        if (!event_log) {
+            cout << "prob after flipping match " << (int)match << " is "
+                 << prob * 100 << "%\n";
+        }
         if (prob > best_prob) {
             cout << "*****  New best!\n";
             best_choices = this_choices;
@@ -1930,7 +4943,9 @@ class SingleGenerator : public OptimGenerator {
     // Later, we can make this the consumer too I guess, so it can base future
     // Stuff on best so far.
     optional<Stuff> get() override {
-        cout << "Generating " << (int)next_match << "\n";
+        if (!event_log) {
+            cout << "Generating " << (int)next_match << "\n";
+        }
         if (next_match >= NUM_GAMES) {
             return nullopt;
         }
@@ -1976,16 +4991,101 @@ pair<array<bool, NUM_GAMES>, double> single_optimize_p(
     */
 }
 
+// The settings that change the probabilities the engine comes up with, for
+// telling searches apart, see CheckpointFile and search_header().
+string engine_settings() {
+    return fmt::format(
+        "model={} mc={},{},{},{} prune={:.17g} collapse={}", config.prob_model,
+        config.monte_carlo_threshold, config.monte_carlo_iters,
+        config.mc_sampling, config.adaptive_mc, config.prune_epsilon,
+        config.collapse_unpicked);
+}
+
+// A long optimizer run's progress, in config.checkpoint_fpath, so a crash or
+// reboot doesn't lose hours of work.  The file is JSON: a header saying which
+// search it is (optimizer, snapshot, pool, entry, starting choices and engine
+// settings), plus whatever state the optimizer needs to carry on.  Resuming a
+// different search is an error rather than a silent restart.
+class CheckpointFile {
+   public:
+    CheckpointFile(const string &optimizer,
+                   const array<bool, NUM_GAMES> &initial_choices,
+                   int entry_to_optimize)
+        : header_{{"optimizer", optimizer},
+                  {"year", config.year},
+                  {"when_run", config.when_run},
+                  {"entries", config.entries},
+                  {"entry_to_optimize", entry_to_optimize},
+                  {"initial_choices", choices_string(initial_choices)},
+                  {"engine", engine_settings()}},
+          last_save_(now()) {}
+
+    // The saved state, if we're resuming and there is one.
+    optional<json> load() const {
+        if (config.checkpoint_fpath.empty() || !config.resume) {
+            return nullopt;
+        }
+        auto raw = read_file(config.checkpoint_fpath);
+        if (!raw) {
+            cout << "No checkpoint in " << config.checkpoint_fpath
+                 << ", starting from the beginning.\n";
+            return nullopt;
+        }
+        json saved = json::parse(*raw, nullptr, false);
+        if (!saved.is_object() || !saved.contains("state")) {
+            throw runtime_error(config.checkpoint_fpath +
+                                " isn't a checkpoint");
+        }
+        if (saved.value("header", json()) != header_) {
+            throw runtime_error(config.checkpoint_fpath +
+                                " is from a different search: " +
+                                saved.value("header", json()).dump());
+        }
+        cout << "Resuming from " << config.checkpoint_fpath << "\n";
+        return saved["state"];
+    }
+
+    // Saves if it's been checkpoint_interval since the last time.  make_state
+    // is only called if so.
+    template <typename F>
+    void maybe_save(F &&make_state) {
+        if (config.checkpoint_fpath.empty() ||
+            elapsed(last_save_, now()) < config.checkpoint_interval) {
+            return;
+        }
+        json saved{{"header", header_}, {"state", make_state()}};
+        write_cache_atomically(config.checkpoint_fpath, saved.dump() + "\n");
+        last_save_ = now();
+    }
+
+   private:
+    json header_;
+    time_point<high_resolution_clock> last_save_;
+};
+
 // In 2022, double_optimize() gave a benefit over single_optimize(): matches 53
 // (Villanova winning Sweet 16) & 58 (Villanova winning Elite 8)
 pair<array<bool, NUM_GAMES>, double> double_optimize(
     array<bool, NUM_GAMES> best_choices, double best_prob,
     int entry_to_optimize, const vector<Bracket> &brackets) {
-    for (game_t outer_match = 0; outer_match < NUM_GAMES; ++outer_match) {
+    CheckpointFile checkpoint("double_optimize", best_choices,
+                              entry_to_optimize);
+    game_t first_outer_match = 0;
+    if (auto state = checkpoint.load()) {
+        first_outer_match = (*state)["next_outer_match"];
+        best_choices = parse_choices((*state)["best_choices"]);
+        best_prob = (*state)["best_prob"];
+    }
+
+    for (game_t outer_match = first_outer_match; outer_match < NUM_GAMES;
+         ++outer_match) {
         array<bool, NUM_GAMES> outer_choices = best_choices;
         outer_choices[outer_match] = !outer_choices[outer_match];
         double outer_prob =
             prob_win(outer_choices, entry_to_optimize, brackets);
+        log_candidate("double_optimize",
+                      "Flipping match " + to_string((int)outer_match),
+                      outer_choices, outer_prob, false);
         cout << "##### Outer.  Best prob so far " << best_prob * 100
              << "%, flipping match " << (int)outer_match
              << " gives probability " << outer_prob * 100 << "%\n";
@@ -1998,6 +5098,11 @@ pair<array<bool, NUM_GAMES>, double> double_optimize(
             cout << "**********  NEW OVERALL BEST!!  New best prob: "
                  << best_prob * 100 << "%\n";
         }
+        checkpoint.maybe_save([&] {
+            return json{{"next_outer_match", outer_match + 1},
+                        {"best_choices", choices_string(best_choices)},
+                        {"best_prob", best_prob}};
+        });
     }
     return make_pair(best_choices, best_prob);
 }
@@ -2016,22 +5121,49 @@ pair<array<bool, NUM_GAMES>, double> all_optimize(
     int best_last_ever_flipped = -1;
     string best_time;
 
-    array<bool, NUM_GAMES> best_choices;
+    array<bool, NUM_GAMES> best_choices{};
+    CheckpointFile checkpoint("all_optimize", initial_choices,
+                              entry_to_optimize);
+    if (auto state = checkpoint.load()) {
+        flipped = parse_choices((*state)["flipped"]);
+        last_ever_flipped = (*state)["last_ever_flipped"];
+        best_prob = (*state)["best_prob"];
+        best_choices = parse_choices((*state)["best_choices"]);
+        best_last_ever_flipped = (*state)["best_last_ever_flipped"];
+        best_time = (*state)["best_time"];
+    }
+
+    ScoreTable score_table(brackets);
     while (last_ever_flipped > 47) {
+        // Everything it takes to start again from this iteration.
+        checkpoint.maybe_save([&] {
+            return json{{"flipped", choices_string(flipped)},
+                        {"last_ever_flipped", last_ever_flipped},
+                        {"best_prob", best_prob},
+                        {"best_choices", choices_string(best_choices)},
+                        {"best_last_ever_flipped", best_last_ever_flipped},
+                        {"best_time", best_time}};
+        });
+
         array<bool, NUM_GAMES> this_choices;
         for (size_t i = 0; i < NUM_GAMES; ++i) {
             this_choices[i] =
                 flipped[i] ? !initial_choices[i] : initial_choices[i];
         }
 
-        double prob = prob_win(this_choices, entry_to_optimize, brackets);
+        double prob = prob_win(this_choices, entry_to_optimize, score_table);
+        string flips;
         for (int i = last_ever_flipped; i < NUM_GAMES; ++i) {
-            cout << (flipped[i] ? 'F' : 'S');
+            flips += flipped[i] ? 'F' : 'S';
+        }
+        log_candidate("all_optimize", flips, this_choices, prob,
+                      prob > best_prob);
+        if (!event_log) {
+            cout << flips << " last ever flipped " << last_ever_flipped
+                 << ", prob: " << prob * 100
+                 << "%, best flipped: " << best_last_ever_flipped << " @ "
+                 << best_time;
         }
-        cout << " last ever flipped " << last_ever_flipped
-             << ", prob: " << prob * 100
-             << "%, best flipped: " << best_last_ever_flipped << " @ "
-             << best_time;
 
         if (prob > best_prob) {
             cout << "*****  New best!\n";
@@ -2067,58 +5199,767 @@ pair<array<bool, NUM_GAMES>, double> all_optimize(
     return make_pair(best_choices, best_prob);
 }
 
-/**********  Putting it all together  **********/
+/**********  Distributed optimizer  **********/
 
-int main(int argc, char *argv[]) {
-    string html = get_entry(entries[0]);
-    const auto teams_json =
-        get_json("espn.fantasy.maxpart.config.scoreboard_teams", html);
-    assert(teams_json.size() == NUM_TEAMS);
-    for (const auto &team : teams_json) {
-        int id = team["id"].get<int>() - 1;
-        teams[id].name = team["n"];
-        teams[id].abbrev = team["a"];
-        eid_to_team[team["eid"].get<int>()] = id;
+// The candidates all_optimize() tries: every combination of flips from the
+// Sweet 16 on, relative to initial_choices, the championship flipping
+// fastest.  Exhaustive, so new_best() doesn't change anything.
+class AllGenerator : public OptimGenerator {
+   public:
+    static constexpr game_t FIRST_MATCH = 48;
+
+    AllGenerator(array<bool, NUM_GAMES> initial_choices)
+        : initial_choices_(initial_choices) {}
+
+    optional<Stuff> get() override {
+        if (next_ >= (uint32_t)1 << (NUM_GAMES - FIRST_MATCH)) {
+            return nullopt;
+        }
+        Stuff ret;
+        ret.choices = initial_choices_;
+        ret.description = "Flipping";
+        for (game_t match = FIRST_MATCH; match < NUM_GAMES; ++match) {
+            if ((next_ >> (NUM_GAMES - 1 - match)) & 1) {
+                ret.choices[match] = !ret.choices[match];
+                ret.description += " " + to_string((int)match);
+            }
+        }
+        ++next_;
+        return ret;
     }
 
-    const auto matchups_json =
-        get_json("espn.fantasy.maxpart.config.scoreboard_matchups", html);
+    void new_best(const Stuff &) override {}
 
-    assert(matchups_json.size() == NUM_GAMES);
-    for (const auto &matchup : matchups_json) {
-        Matchup m = parse_matchup(matchup);
-        games[m.id] = m;
-#if WITH_BOOLEXPR
-        if (m.winner < 0) {
-            const string &rname = round_names[round_index(m.id + 1).round];
-            const string first_name =
-                (m.first_team < 0 ? to_string(m.id) + "first"
-                                  : teams[m.first_team].abbrev);
-            const string second_name =
-                (m.second_team < 0 ? to_string(m.id) + "second"
-                                   : teams[m.second_team].abbrev);
-            Var::all_vars[m.id] = make_pair(
-                make_shared<Var>(first_name + "-" + rname, m.id, true),
-                make_shared<Var>(second_name + "-" + rname, m.id, false));
+   private:
+    array<bool, NUM_GAMES> initial_choices_;
+    uint32_t next_ = 0;
+};
+
+// Which search this is, so a worker started with a different snapshot, pool,
+// starting bracket or engine settings refuses to take part instead of sending
+// back probabilities from some other search.
+string search_header(int entry_to_optimize,
+                     const array<bool, NUM_GAMES> &initial_choices) {
+    string entries;
+    for (auto entry : config.entries) {
+        entries += (entries.empty() ? "" : ",") + to_string(entry);
+    }
+    return fmt::format("search {} {} {} {} {} {}", config.year,
+                       config.when_run, entries, entry_to_optimize,
+                       choices_string(initial_choices), engine_settings());
+}
+
+// Like Distributor, but the workers are other processes, see run_worker(),
+// each connected on a socket, so a search can use every core of several
+// processes, or, with a tunnel, machines.  The generator stays here, so
+// there's nothing to broadcast: new_best() takes effect for every worker at
+// once.  A candidate whose worker goes away is handed to the next one.
+//
+// The protocol is lines of text.  On connecting the worker gets the
+// search_header(), then "eval <choices>" for each candidate, see
+// choices_string(), and answers with the probability.  "done" when there's
+// nothing left.
+//
+// Returns the best once every candidate has been evaluated.
+class Coordinator {
+   public:
+    Coordinator(unique_ptr<OptimGenerator> generator, int entry_to_optimize,
+                const array<bool, NUM_GAMES> &initial_choices)
+        : generator_(std::move(generator)),
+          header_(search_header(entry_to_optimize, initial_choices)) {}
+
+    pair<array<bool, NUM_GAMES>, double> run(int port) {
+        int listen_fd = listen_on_loopback(port);
+        cout << "Coordinating on 127.0.0.1:" << port << ", start workers with "
+             << "--worker " << port << endl;
+        thread acceptor([&] {
+            for (;;) {
+                int fd = accept(listen_fd, nullptr, nullptr);
+                if (fd < 0) {
+                    return;
+                }
+                scoped_lock lock(mutex_);
+                ++num_workers_;
+                thread(&Coordinator::serve_worker, this, fd).detach();
+            }
+        });
+
+        unique_lock lock(mutex_);
+        changed_.wait(lock, [&] {
+            return exhausted_ && retry_.empty() && in_flight_ == 0;
+        });
+        shutdown(listen_fd, SHUT_RDWR);
+        close(listen_fd);
+        lock.unlock();
+        acceptor.join();
+
+        // Every worker thread has been told "done" or is about to be, but
+        // they use this, so wait until they're all gone.
+        lock.lock();
+        changed_.wait(lock, [&] { return num_workers_ == 0; });
+
+        cout << evaluated_ << " candidates evaluated.\n";
+        return make_pair(best_choices_, best_prob_);
+    }
+
+   private:
+    // Blocks while there's nothing to hand out but candidates are still out
+    // with workers, in case one of them has to be redone.
+    optional<Stuff> get_work(unique_lock<mutex> &lock) {
+        for (;;) {
+            if (!retry_.empty()) {
+                Stuff work = std::move(retry_.front());
+                retry_.pop_front();
+                return work;
+            }
+            if (!exhausted_) {
+                if (optional<Stuff> work = generator_->get()) {
+                    return work;
+                }
+                exhausted_ = true;
+            }
+            if (in_flight_ == 0) {
+                return nullopt;
+            }
+            changed_.wait(lock);
+        }
+    }
+
+    void serve_worker(int fd) {
+        serve_candidates(fd);
+        close(fd);
+
+        scoped_lock lock(mutex_);
+        --num_workers_;
+        changed_.notify_all();
+    }
+
+    // Hands candidates to the worker on fd until there are none left, or it
+    // goes away.
+    void serve_candidates(int fd) {
+        string buffer;
+        bool ok = send_all(fd, header_ + "\n");
+        while (ok) {
+            optional<Stuff> work;
+            {
+                unique_lock lock(mutex_);
+                work = get_work(lock);
+                if (!work) {
+                    changed_.notify_all();
+                    break;
+                }
+                ++in_flight_;
+            }
+
+            optional<string> answer;
+            if (send_all(fd, "eval " + choices_string(work->choices) + "\n")) {
+                answer = recv_line(fd, buffer);
+            }
+
+            optional<double> prob;
+            if (answer) {
+                try {
+                    size_t used;
+                    prob = stod(*answer, &used);
+                    if (used != answer->size()) {
+                        prob.reset();
+                    }
+                } catch (const invalid_argument &) {
+                } catch (const out_of_range &) {
+                }
+            }
+
+            scoped_lock lock(mutex_);
+            --in_flight_;
+            changed_.notify_all();
+            if (!prob) {
+                cout << "Worker went away or made no sense, redoing: "
+                     << work->description << endl;
+                retry_.push_back(std::move(*work));
+                return;
+            }
+            work->prob = *prob;
+            ++evaluated_;
+            log_candidate("coordinator", work->description, work->choices,
+                          work->prob, work->prob > best_prob_);
+            if (!event_log) {
+                cout << work->description << ", prob: " << work->prob * 100
+                     << "%\n";
+            }
+            if (work->prob > best_prob_) {
+                cout << "*****  New best!\n";
+                best_choices_ = work->choices;
+                best_prob_ = work->prob;
+                generator_->new_best(*work);
+            }
+        }
+        send_all(fd, "done\n");
+    }
+
+    mutex mutex_;
+    condition_variable changed_;
+    unique_ptr<OptimGenerator> generator_;
+    const string header_;
+    deque<Stuff> retry_;
+    bool exhausted_ = false;
+    size_t in_flight_ = 0;
+    // serve_worker() threads still running.
+    size_t num_workers_ = 0;
+    size_t evaluated_ = 0;
+    array<bool, NUM_GAMES> best_choices_{};
+    double best_prob_ = -1;
+};
+
+// Evaluates candidates for the Coordinator on port until it says "done".
+void run_worker(int port, int entry_to_optimize,
+                const vector<Bracket> &brackets) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = loopback_addr(port);
+    if (fd < 0 ||
+        connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        throw runtime_error("Couldn't connect to coordinator on port " +
+                            to_string(port));
+    }
+
+    string buffer;
+    optional<string> header = recv_line(fd, buffer);
+    if (header !=
+        search_header(entry_to_optimize, make_most_likely_bracket().second)) {
+        close(fd);
+        throw runtime_error("Coordinator is running a different search: " +
+                            header.value_or("(nothing)"));
+    }
+
+    ScoreTable score_table(brackets);
+    size_t evaluated = 0;
+    while (optional<string> line = recv_line(fd, buffer)) {
+        if (!line->starts_with("eval ")) {
+            break;
+        }
+        double prob = prob_win(parse_choices(line->substr(5)),
+                               entry_to_optimize, score_table);
+        if (!send_all(fd, fmt::format("{:.17g}\n", prob))) {
+            break;
+        }
+        ++evaluated;
+    }
+    close(fd);
+    cout << "Worker done, evaluated " << evaluated << " candidates.\n";
+}
+
+/**********  Benchmark  **********/
+
+// Swallows everything written to cout while it's alive, so the optimizers can
+// be timed without their chatter.
+class QuietCout {
+   public:
+    QuietCout() : saved_(cout.rdbuf(nullptr)) {}
+    ~QuietCout() {
+        cout.rdbuf(saved_);
+        cout.clear();
+    }
+
+   private:
+    streambuf *saved_;
+};
+
+// Times one snapshot, config.when_run, that's already in the cache.
+json benchmark_snapshot() {
+    load_tournament(get_entry(config.entries[0]));
+    vector<Bracket> brackets;
+    for (auto entry : config.entries) {
+        brackets.push_back(get_bracket(entry));
+    }
+    parse_probs();
+
+    json result;
+    result["when_run"] = config.when_run;
+    result["games_played"] = count_if(
+        games.begin(), games.end(), [](const Matchup &m) { return m.winner >= 0; });
+
+    // Each round on top of the ones before it, so every round is only
+    // charged for its own games.
+    OutcomesCache cache;
+    result["rounds"] = json::array();
+    for (game_t first = 0; first < NUM_GAMES;) {
+        const auto ri = round_index(first + 1);
+        auto start = now();
+        size_t num_result_sets = 0;
+        for (game_t match = first; match < first + ri.num_matches; ++match) {
+            for (const Outcomes &outcome :
+                 cached_outcomes(match, brackets, &cache)) {
+                num_result_sets += outcome.result_sets.size();
+            }
+        }
+        result["rounds"].push_back({{"round", round_names[ri.round]},
+                                    {"sec", elapsed(start, now())},
+                                    {"result_sets", num_result_sets}});
+        first += ri.num_matches;
+    }
+
+    auto start = now();
+    auto results = outcomes(NUM_GAMES - 1, brackets);
+    result["outcomes_sec"] = elapsed(start, now());
+    start = now();
+    get_win_probs(results, brackets.size());
+    result["get_win_probs_sec"] = elapsed(start, now());
+
+    auto choices = make_most_likely_bracket().second;
+    start = now();
+    double prob = prob_win(choices, 0, brackets);
+    result["prob_win_sec"] = elapsed(start, now());
+
+    // The optimizers only differ in which candidates they try, and how:
+    // single_optimize() (like double_optimize() and all_optimize()) one at a
+    // time, single_optimize_p() on all cores.  single_optimize() from the
+    // Sweet 16 on, so the benchmark doesn't take all day.
+    auto time_optimizer = [&](game_t num_candidates, auto &&optimize) {
+        QuietCout quiet;
+        auto start = now();
+        optimize();
+        double sec = elapsed(start, now());
+        return json{{"candidates", num_candidates},
+                    {"sec", sec},
+                    {"candidates_per_sec", num_candidates / sec}};
+    };
+    const game_t first_match = 48;
+    result["single_optimize"] =
+        time_optimizer(NUM_GAMES - first_match, [&] {
+            single_optimize(choices, prob, 0, first_match, brackets);
+        });
+    result["single_optimize_p"] = time_optimizer(
+        NUM_GAMES, [&] { single_optimize_p(choices, prob, 0, brackets); });
+
+    return result;
+}
+
+// Times the engine on every snapshot under fixtures_dir that has all of
+// config.entries and its forecasts.  Never touches the network: with
+// cache_max_age < 0 a page that's already cached is never fetched, and
+// snapshots with anything missing are skipped.  The results are JSON on
+// stdout, so they can be kept and compared from one change to the next.
+void run_benchmark(const string &fixtures_dir) {
+    filesystem::current_path(fixtures_dir);
+    config.cache_max_age = -1;
+
+    // Every snapshot the first entry has a page for.
+    const regex page_name(fmt::format("{}-(.*)\\.html", config.entries[0]));
+    vector<string> snapshots;
+    for (const auto &file :
+         filesystem::directory_iterator(config.year + "/pages")) {
+        smatch match;
+        string name = file.path().filename().string();
+        if (regex_match(name, match, page_name)) {
+            snapshots.push_back(match[1]);
+        }
+    }
+    sort(snapshots.begin(), snapshots.end());
+
+    json output;
+    output["year"] = config.year;
+    output["entries"] = config.entries;
+    output["monte_carlo_threshold"] = config.monte_carlo_threshold;
+    output["monte_carlo_iters"] = config.monte_carlo_iters;
+    output["threads"] = thread::hardware_concurrency();
+    output["snapshots"] = json::array();
+    auto start = now();
+    for (const string &snapshot : snapshots) {
+        config.when_run = snapshot;
+        bool complete = filesystem::exists(forecasts_fpath());
+        for (auto entry : config.entries) {
+            complete = complete && filesystem::exists(entry_fpath(entry));
+        }
+        if (!complete) {
+            cerr << "Skipping " << snapshot << ", missing pages\n";
+            continue;
+        }
+        output["snapshots"].push_back(benchmark_snapshot());
+    }
+    output["elapsed"] = elapsed(start, now());
+    cout << output.dump(4) << "\n";
+}
+
+/**********  Accuracy  **********/
+
+// Known good numbers, from 2022 before-roundof64 with the default entries.
+
+// Match 41 (2nd from the top Round of 32 game in the South), from the exact
+// engine: who can win it, with what scores and how likely.
+struct KnownTuple {
+    string team;
+    array<int, MAX_BRACKETS> scores;
+    double prob;
+};
+
+const vector<KnownTuple> known_match_41{
+    {"Houston", {30, 30, 10, 10, 30, 10, 0, 30}, 0.104051},
+    {"Houston", {40, 40, 20, 20, 40, 0, 10, 40}, 0.332539},
+    {"Illinois", {0, 0, 20, 20, 0, 0, 10, 0}, 0.109205},
+    {"Illinois", {20, 20, 40, 40, 20, 0, 10, 20}, 0.286999},
+    {"Chattanooga", {0, 0, 0, 0, 0, 40, 10, 0}, 0.018375},
+    {"Chattanooga", {10, 10, 10, 10, 10, 30, 0, 10}, 0.044459},
+    {"UAB", {0, 0, 0, 0, 0, 20, 30, 0}, 0.026475},
+    {"UAB", {0, 0, 0, 0, 0, 0, 30, 0}, 0.077896},
+};
+
+// Entry 0's chance of first place with the most likely bracket, and with
+// best_choices_2022.
+constexpr double KNOWN_MOST_LIKELY = 0.2153;
+constexpr double KNOWN_BEST_2022 = 0.2509;
+
+// One way of evaluating the pool, and how close it has to come.  The known
+// whole-pool numbers came from 100,000 iter Monte Carlo runs and were written
+// down to 0.01%, so even the hybrid engine can't be held to much better than
+// a few tenths of a percent.
+struct Engine {
+    string name;
+    function<void(Config &)> setup;
+    double tuple_tolerance;
+    double pool_tolerance;
+    // Exact can't do the whole pool before the round of 64.
+    bool whole_pool = true;
+};
+
+// Checks every engine against the known numbers, timing each, and prints a
+// line per check.  Returns whether everything passed.
+bool run_accuracy(const vector<Bracket> &brackets) {
+    const vector<Engine> engines{
+        {"exact",
+         [](Config &c) { c.monte_carlo_threshold = size_t(1) << 60; }, 1e-6,
+         0, false},
+        {"hybrid", [](Config &) {}, 1e-6, 0.003},
+        {"hybrid-sobol", [](Config &c) { c.mc_sampling = "sobol"; }, 1e-6,
+         0.003},
+        {"hybrid-adaptive", [](Config &c) { c.adaptive_mc = true; }, 1e-6,
+         0.003},
+        {"pruned", [](Config &c) { c.prune_epsilon = 1e-9; }, 1e-6, 0.003},
+        {"collapse-unpicked", [](Config &c) { c.collapse_unpicked = true; },
+         1e-6, 0.003},
+        {"monte-carlo", [](Config &c) { c.monte_carlo_threshold = 0; }, 0.005,
+         0.01},
+    };
+
+    const Config saved = config;
+    bool all_passed = true;
+    auto check = [&](const string &engine, const string &what, double expected,
+                     double got, double tolerance) {
+        bool passed = fabs(got - expected) <= tolerance;
+        all_passed = all_passed && passed;
+        cout << fmt::format("{:<18} {:<52} {:9.6f} {:9.6f} +-{:<9.6f} {}\n",
+                            engine, what, expected, got, tolerance,
+                            passed ? "ok" : "FAIL");
+    };
+
+    cout << fmt::format("{:<18} {:<52} {:>9} {:>9}\n", "engine", "check",
+                        "expected", "got");
+    for (const Engine &engine : engines) {
+        config = saved;
+        engine.setup(config);
+        auto start = now();
+
+        auto result = outcomes(41, brackets);
+        for (const KnownTuple &known : known_match_41) {
+            scoretuple_t scores = 0;
+            for (size_t i = 0; i < MAX_BRACKETS; ++i) {
+                scores |= (scoretuple_t)(known.scores[i] / 10) << (8 * i);
+            }
+            double got = 0;
+            for (const Outcomes &outcome : result) {
+                auto iter = outcome.result_sets.find(scores);
+                if (iter == outcome.result_sets.end()) {
+                    continue;
+                }
+                if (outcome.team >= 0) {
+                    if (teams[outcome.team].name == known.team) {
+                        got = iter->second.prob;
+                    }
+                    continue;
+                }
+                // A bucket, known.team's share is in its members.
+                for (const Member<double> &member :
+                     outcome.members.at(scores)) {
+                    if (teams[member.team].name == known.team) {
+                        got += member.prob;
+                    }
+                }
+            }
+            check(engine.name,
+                  "match 41 " + known.team + " " +
+                      make_string(scores, brackets.size()),
+                  known.prob, got, engine.tuple_tolerance);
         }
+
+        if (engine.whole_pool) {
+            check(engine.name, "most likely bracket", KNOWN_MOST_LIKELY,
+                  prob_win(make_most_likely_bracket().second, 0, brackets),
+                  engine.pool_tolerance);
+            check(engine.name, "best_choices_2022", KNOWN_BEST_2022,
+                  prob_win(best_choices_2022, 0, brackets),
+                  engine.pool_tolerance);
+        }
+        cout << fmt::format("{:<18} {:.3f} sec\n", engine.name,
+                            elapsed(start, now()));
+    }
+    config = saved;
+
+    return all_passed;
+}
+
+/**********  Putting it all together  **********/
+
+// A JSON object with any of the keys below, e.g.
+//
+//   {"year": "2023", "when_run": "before-sweet16",
+//    "entries": [60122219, 62328104], "monte_carlo_iters": 1000000}
+void load_config_file(const string &fpath, Config &result) {
+    auto raw = read_file(fpath);
+    if (!raw) {
+        throw runtime_error("Couldn't read config file " + fpath);
+    }
+    for (const auto &[key, value] : json::parse(*raw).items()) {
+        if (key == "year") {
+            result.year = value;
+        } else if (key == "when_run") {
+            result.when_run = value;
+        } else if (key == "entries") {
+            result.entries = value.get<vector<uint64_t>>();
+        } else if (key == "monte_carlo_threshold") {
+            result.monte_carlo_threshold = value;
+        } else if (key == "monte_carlo_iters") {
+            result.monte_carlo_iters = value;
+        } else if (key == "prob_model") {
+            result.prob_model = value;
+        } else if (key == "url_base") {
+            result.url_host_override = value;
+        } else if (key == "revalidate") {
+            result.cache_max_age = value;
+        } else if (key == "max_in_flight") {
+            result.max_in_flight = value;
+        } else if (key == "ensemble_sigma") {
+            result.ensemble_sigma = value;
+        } else if (key == "ensemble_seed") {
+            result.ensemble_seed = value;
+        } else if (key == "collapse_unpicked") {
+            result.collapse_unpicked = value;
+        } else if (key == "prune_epsilon") {
+            result.prune_epsilon = value;
+        } else if (key == "checkpoint") {
+            result.checkpoint_fpath = value;
+        } else if (key == "checkpoint_interval") {
+            result.checkpoint_interval = value;
+        } else if (key == "events") {
+            result.events_fpath = value;
+        } else if (key == "adaptive_mc") {
+            result.adaptive_mc = value;
+        } else if (key == "mc_replicates") {
+            result.mc_replicates = value;
+        } else if (key == "mc_sampling") {
+            result.mc_sampling = value;
+        } else {
+            throw runtime_error("Unknown key in " + fpath + ": " + key);
+        }
+    }
+}
+
+// Flags are applied in order, so e.g. "--config pool.json --when
+// before-final4" uses everything from pool.json except when_run.
+Config parse_args(int argc, char *argv[]) {
+    Config result;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--config" && has_value) {
+            load_config_file(argv[++i], result);
+        } else if (arg == "--year" && has_value) {
+            result.year = argv[++i];
+        } else if (arg == "--when" && has_value) {
+            result.when_run = argv[++i];
+        } else if (arg == "--entries" && has_value) {
+            result.entries.clear();
+            for (const auto &entry : split(argv[++i], ',')) {
+                result.entries.push_back(stoull(entry));
+            }
+        } else if (arg == "--mc-threshold" && has_value) {
+            result.monte_carlo_threshold = stoul(argv[++i]);
+        } else if (arg == "--mc-iters" && has_value) {
+            result.monte_carlo_iters = stoul(argv[++i]);
+        } else if (arg == "--model" && has_value) {
+            result.prob_model = argv[++i];
+        } else if (arg == "--serve" && has_value) {
+            result.serve_port = stoi(argv[++i]);
+        } else if (arg == "--fail-every" && has_value) {
+            result.fail_every = stoi(argv[++i]);
+        } else if (arg == "--url-base" && has_value) {
+            result.url_host_override = argv[++i];
+        } else if (arg == "--max-in-flight" && has_value) {
+            result.max_in_flight = stoul(argv[++i]);
+        } else if (arg == "--revalidate" && has_value) {
+            result.cache_max_age = stod(argv[++i]);
+        } else if (arg == "--live" && has_value) {
+            result.live_poll_interval = stod(argv[++i]);
+        } else if (arg == "--batch" && has_value) {
+            result.batch_fpath = argv[++i];
+        } else if (arg == "--batch-output" && has_value) {
+            result.batch_output_fpath = argv[++i];
+        } else if (arg == "--ensemble" && has_value) {
+            result.ensemble_sigma = stod(argv[++i]);
+        } else if (arg == "--ensemble-seed" && has_value) {
+            result.ensemble_seed = stoull(argv[++i]);
+        } else if (arg == "--collapse-unpicked") {
+            result.collapse_unpicked = true;
+        } else if (arg == "--prune" && has_value) {
+            result.prune_epsilon = stod(argv[++i]);
+        } else if (arg == "--adaptive-mc") {
+            result.adaptive_mc = true;
+        } else if (arg == "--mc-replicates" && has_value) {
+            result.mc_replicates = stoi(argv[++i]);
+        } else if (arg == "--mc-sampling" && has_value) {
+            result.mc_sampling = argv[++i];
+        } else if (arg == "--mc-convergence") {
+            result.mc_convergence = true;
+        } else if (arg == "--bench" && has_value) {
+            result.bench_fixtures = argv[++i];
+        } else if (arg == "--profile") {
+            result.profile = true;
+        } else if (arg == "--accuracy") {
+            result.accuracy = true;
+        } else if (arg == "--checkpoint" && has_value) {
+            result.checkpoint_fpath = argv[++i];
+        } else if (arg == "--checkpoint-interval" && has_value) {
+            result.checkpoint_interval = stod(argv[++i]);
+        } else if (arg == "--resume") {
+            result.resume = true;
+        } else if (arg == "--coordinate" && has_value) {
+            result.coordinate_port = stoi(argv[++i]);
+        } else if (arg == "--worker" && has_value) {
+            result.worker_port = stoi(argv[++i]);
+        } else if (arg == "--search" && has_value) {
+            result.distributed_search = argv[++i];
+        } else if (arg == "--events" && has_value) {
+            result.events_fpath = argv[++i];
+        } else if (arg == "--query" && has_value) {
+            result.query_port = stoi(argv[++i]);
+        } else if (arg == "--fetch-only") {
+            result.fetch_only = true;
+        } else {
+            throw runtime_error("Unknown or incomplete argument: " + arg);
+        }
+    }
+
+    if (result.entries.size() < 2 || result.entries.size() > MAX_BRACKETS) {
+        throw runtime_error(fmt::format("Need between 2 and {} entries, got {}.",
+                                        MAX_BRACKETS, result.entries.size()));
+    }
+    if (result.live_poll_interval > 0 && result.cache_max_age < 0) {
+        result.cache_max_age = 0;
+    }
+    if (result.accuracy &&
+        (result.year != "2022" || result.when_run != "before-roundof64" ||
+         result.entries != Config{}.entries)) {
+        throw runtime_error(
+            "--accuracy knows the numbers for 2022, before-roundof64, with the "
+            "default entries.");
+    }
+    if (result.distributed_search != "all" &&
+        result.distributed_search != "single") {
+        throw runtime_error("Unknown search: " + result.distributed_search);
+    }
+    if (result.resume && result.checkpoint_fpath.empty()) {
+        throw runtime_error("--resume needs --checkpoint FILE");
+    }
+    if (result.profile && !WITH_PROFILE) {
+        throw runtime_error("--profile needs a build with -DWITH_PROFILE=1");
+    }
+    if (result.mc_sampling != "random" && result.mc_sampling != "sobol") {
+        throw runtime_error("Unknown Monte Carlo sampling: " +
+                            result.mc_sampling);
+    }
+
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        config = parse_args(argc, argv);
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+    if (!config.events_fpath.empty()) {
+        event_log = make_unique<EventLog>(config.events_fpath);
+    }
+#if WITH_PROFILE
+    if (config.profile) {
+        atexit(print_profile);
+    }
 #endif
+
+    if (config.serve_port > 0) {
+        serve(config.serve_port, config.fail_every);
+        return 0;
+    }
+
+    if (!config.batch_fpath.empty()) {
+        run_batch(config.batch_fpath, config.batch_output_fpath);
+        return 0;
+    }
+
+    if (!config.bench_fixtures.empty()) {
+        run_benchmark(config.bench_fixtures);
+        return 0;
     }
 
+    size_t num_changed = prefetch(config.entries, config.max_in_flight);
+    if (config.cache_max_age >= 0) {
+        auto forecasts = page_cache.meta(forecasts_url());
+        cout << num_changed << " pages changed, snapshot "
+             << page_cache.snapshot_id(input_urls()) << ", 538 forecasts as of "
+             << format_time(forecasts->fetched_at) << "\n";
+    }
+    if (config.fetch_only) {
+        return 0;
+    }
+
+    load_tournament(get_entry(config.entries[0]));
+
     vector<Bracket> brackets;
 
-    for (auto entry : entries) {
+    for (auto entry : config.entries) {
         brackets.push_back(get_bracket(entry));
     }
 
     // brackets[0] = make_bracket(best_choices_2022);
 
-    assert(brackets.size() == NUM_BRACKETS);
+    assert(brackets.size() == config.entries.size());
 
-    make_all_selections(brackets);
+    parse_probs();
 
-    assert(all_selections.size() == NUM_GAMES);
+    if (config.ensemble_sigma > 0) {
+        run_ensemble(brackets, config.ensemble_sigma, config.ensemble_seed);
+        return 0;
+    }
 
-    parse_probs();
+    if (config.accuracy) {
+        return run_accuracy(brackets) ? 0 : 1;
+    }
+
+    if (config.mc_convergence) {
+        run_convergence(brackets, max(config.mc_replicates, 10));
+        return 0;
+    }
+
+    if (config.mc_replicates > 1) {
+        run_replicates(brackets, config.mc_replicates);
+        return 0;
+    }
+
+    if (config.live_poll_interval > 0) {
+        live_update(brackets, config.live_poll_interval);
+    }
+
+    if (config.query_port > 0) {
+        run_query_service(brackets, config.query_port);
+    }
 
     /*
     for (team_t i = 48; i < 48 + 8; i++)
@@ -2139,7 +5980,7 @@ int main(int argc, char *argv[]) {
    {
       cout << "**********  Top Round of 32 game in the South\n";
       // matches: 16, 17, 40
-      auto result = outcomes(40, all_selections[52]);
+      auto result = outcomes(40, brackets);
       for (const auto &outcome : result)
       {
          if (!outcome.result_sets.empty())
@@ -2152,7 +5993,7 @@ int main(int argc, char *argv[]) {
    {
       cout << "**********  2nd from the top Round of 32 game in the South\n";
       // matches: 18, 19, 41
-      auto result = outcomes(41, all_selections[52]);
+      auto result = outcomes(41, brackets);
       for (const auto &outcome : result)
       {
          if (!outcome.result_sets.empty())
@@ -2171,7 +6012,7 @@ int main(int argc, char *argv[]) {
    {
       cout << "**********  Top Sweet 16 in the South\n";
       // matches: 16, 17, 18, 19, 40, 41, 52
-      auto result = outcomes(52, all_selections[52]);
+      auto result = outcomes(52, brackets);
       for (const auto &outcome : result)
       {
          if (!outcome.result_sets.empty())
@@ -2190,7 +6031,7 @@ int main(int argc, char *argv[]) {
    {
       cout << "**********  Elite 8 in the South\n";
       // matches: 16, 17, 18, 19, 20, 21, 22, 23, 40, 41, 42, 43, 52, 53, 58
-      auto result = outcomes(58, all_selections[58]);
+      auto result = outcomes(58, brackets);
       for (const auto &outcome : result)
       {
          if (!outcome.result_sets.empty())
@@ -2202,7 +6043,7 @@ int main(int argc, char *argv[]) {
 
    {
       cout << "**********  Elite 8 in the West\n";
-      auto result = outcomes(56, all_selections[56]);
+      auto result = outcomes(56, brackets);
       for (const auto &outcome : result)
       {
          if (!outcome.result_sets.empty())
@@ -2214,7 +6055,7 @@ int main(int argc, char *argv[]) {
 
    {
       cout << "**********  Final 4 West & East\n";
-      auto west_east = outcomes(60, all_selections[62]);
+      auto west_east = outcomes(60, brackets);
       for (const auto &outcome : west_east)
       {
          if (!outcome.result_sets.empty())
@@ -2226,7 +6067,7 @@ int main(int argc, char *argv[]) {
 
    {
       cout << "**********  Midwest & South\n";
-      auto midwest_south = outcomes(61, all_selections[62]);
+      auto midwest_south = outcomes(61, brackets);
       for (const auto &outcome : midwest_south)
       {
          if (!outcome.result_sets.empty())
@@ -2238,21 +6079,21 @@ int main(int argc, char *argv[]) {
       }
    }
 
-   vector<bool> bracket_eliminated(NUM_BRACKETS);
+   vector<bool> bracket_eliminated(brackets.size());
    {
       cout << "**********  Whole Thing!\n";
       auto start = now();
-      auto results = outcomes(62, {}, brackets);
+      auto results = outcomes(62, brackets);
       cout << "Whole thing elapsed " << elapsed(start, now()) << " sec.\n";
 
-      auto win_probs = get_win_probs(results);
+      auto win_probs = get_win_probs(results, brackets.size());
 
       sort(win_probs.begin(), win_probs.end(), [](auto &a, auto &b)
            { return a.first_place.prob != b.first_place.prob ? a.first_place.prob > b.first_place.prob : a.second_place.prob != b.second_place.prob ? a.second_place.prob > b.second_place.prob
                                                                                                                                                     : a.bracket < b.bracket; });
 
       cout << "***** Probability of Win & 2nd place for each Bracket *****\n";
-      for (int i = 0; i < NUM_BRACKETS; ++i)
+      for (int i = 0; i < brackets.size(); ++i)
       {
          int bracket_num = win_probs[i].bracket;
          cout << fmt::format("{:<22}: {:5.2f}% {:5.2f}%", brackets[bracket_num].name, win_probs[i].first_place.prob * 100, win_probs[i].second_place.prob * 100)
@@ -2355,17 +6196,49 @@ int main(int argc, char *argv[]) {
     // compare(make_bracket(even_better, "Best so far"),
     // make_most_likely_bracket().first);
 
+    if (config.worker_port > 0) {
+        run_worker(config.worker_port, entry_to_optimize, brackets);
+        return 0;
+    }
+
+    if (config.coordinate_port > 0) {
+        array<bool, NUM_GAMES> initial = make_most_likely_bracket().second;
+        unique_ptr<OptimGenerator> generator;
+        if (config.distributed_search == "all") {
+            generator = make_unique<AllGenerator>(initial);
+        } else {
+            generator = make_unique<SingleGenerator>(initial);
+        }
+        auto [best_choices, best_prob] =
+            Coordinator(std::move(generator), entry_to_optimize, initial)
+                .run(config.coordinate_port);
+        cout << "Best: " << best_prob * 100 << "%\n";
+        compare(make_bracket(best_choices, "Optimized"),
+                make_bracket(initial, "Initial"));
+        cout << "array<bool, NUM_GAMES> who_wins ";
+        cout << to_string(best_choices) << ";\n";
+        return 0;
+    }
+
     cout << "**********  Optimizer!  **********\n";
     array<bool, NUM_GAMES> to_optimize = make_most_likely_bracket().second;
     cout << to_string(make_bracket(to_optimize));
 
     double best_p = prob_win(to_optimize, entry_to_optimize, brackets);
     cout << "+++++ Baseline probability: " << best_p * 100 << "% +++++\n";
+    log_candidate("baseline", "Most likely", to_optimize, best_p, true);
 
     auto start = now();
     auto best_ever = make_bracket(even_better, "Best Ever");
-    /* auto [best_choices, best_prob] =*/all_optimize(
-        to_optimize, entry_to_optimize, brackets, best_ever);
+    // A checkpoint we can't resume from, say, is for the user to sort out,
+    // not a crash.
+    try {
+        /* auto [best_choices, best_prob] =*/all_optimize(
+            to_optimize, entry_to_optimize, brackets, best_ever);
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return 1;
+    }
 
     // /* auto [best_choices, best_prob] =*/double_optimize(to_optimize, best_p,
     //                                                      entry_to_optimize,
@@ -2415,13 +6288,13 @@ int main(int argc, char *argv[]) {
       auto original_winner = matchup.winner;
 
       matchup.winner = matchup.first_team;
-      auto results = outcomes(62, {}, brackets);
-      auto win_probs = get_win_probs(results);
+      auto results = outcomes(62, brackets);
+      auto win_probs = get_win_probs(results, brackets.size());
       alternate_win_probs.push_back({match_index, true, matchup.winner, win_probs[bracket_to_consider].first_place.prob});
 
       matchup.winner = matchup.second_team;
-      results = outcomes(62, {}, brackets);
-      win_probs = get_win_probs(results);
+      results = outcomes(62, brackets);
+      win_probs = get_win_probs(results, brackets.size());
       alternate_win_probs.push_back({match_index, false, matchup.winner, win_probs[bracket_to_consider].first_place.prob});
 
       matchup.winner = original_winner;
@@ -2434,7 +6307,7 @@ int main(int argc, char *argv[]) {
       cout << fmt::format("{:5.2f}% {} ({} {})\n", alt.prob * 100, teams[alt.winning_team].name, alt.match, alt.first ? "first" : "second");
    }
 
-   for (int bracket_to_consider = 0; bracket_to_consider < NUM_BRACKETS; ++bracket_to_consider)
+   for (int bracket_to_consider = 0; bracket_to_consider < brackets.size(); ++bracket_to_consider)
    {
       if (bracket_eliminated[bracket_to_consider])
       {